@@ -645,6 +645,15 @@ void checkButtons(void)
 void usbLoop(bool firmware_present)
 {
 	brand_new_firmware = !firmware_present;
+#ifdef APPVER
+	// handoff from the firmware which started us from RAM
+	if (FASTFLASH_MAILBOX->magic == FASTFLASH_MAILBOX_MAGIC) {
+		if (FASTFLASH_MAILBOX->flags & FASTFLASH_FLAG_OPEN) {
+			flash_state = STATE_OPEN;
+		}
+		FASTFLASH_MAILBOX->magic = 0;
+	}
+#endif
 	usbInit();
 	for (;;) {
 		usbd_poll(usbd_dev);
@@ -29,6 +29,7 @@
 extern void *emulator_flash_base;
 
 void emulatorPoll(void);
+void emulatorExitPoll(void);
 void emulatorRandom(void *buffer, size_t size);
 
 void emulatorSocketInit(void);
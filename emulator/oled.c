@@ -23,7 +23,9 @@
 
 void oledInit(void) {}
 void oledRefresh(void) {}
-void emulatorPoll(void) {}
+void emulatorPoll(void) {
+	emulatorExitPoll();
+}
 
 #else
 
@@ -111,6 +113,8 @@ void oledRefresh(void) {
 void emulatorPoll(void) {
 	SDL_Event event;
 
+	emulatorExitPoll();
+
 	if (SDL_PollEvent(&event)) {
 		if (event.type == SDL_QUIT) {
 			exit(1);
@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
@@ -40,12 +41,16 @@ uint32_t __stack_chk_guard;
 
 static int urandom = -1;
 
+static volatile sig_atomic_t exit_requested = 0;
+
 static void setup_urandom(void);
 static void setup_flash(void);
+static void setup_signals(void);
 
 void setup(void) {
 	setup_urandom();
 	setup_flash();
+	setup_signals();
 }
 
 void emulatorRandom(void *buffer, size_t size) {
@@ -93,3 +98,21 @@ static void setup_flash(void) {
 		flash_erase_all_sectors(FLASH_CR_PROGRAM_X32);
 	}
 }
+
+static void exit_handler(int signum) {
+	(void) signum;
+	// exit() is not async-signal-safe, leave it to emulatorExitPoll
+	exit_requested = 1;
+}
+
+void emulatorExitPoll(void) {
+	if (exit_requested) {
+		// run the atexit handlers (e.g. statistics dump)
+		exit(0);
+	}
+}
+
+static void setup_signals(void) {
+	signal(SIGINT, exit_handler);
+	signal(SIGTERM, exit_handler);
+}
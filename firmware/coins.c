@@ -24,12 +24,88 @@
 #include "ecdsa.h"
 #include "base58.h"
 #include "secp256k1.h"
+#include "storage.h"
 
 // filled CoinInfo structure defined in coins.h
 const CoinInfo coins[COINS_COUNT] = {
 #include "coins_array.h"
 };
 
+/*
+ * Coins installed at runtime (LoadCoinDefinitions) live in the storage
+ * as a signed table sorted by coin name.  Its signature is checked once
+ * when it is installed; at boot it is turned into CoinInfo entries
+ * pointing into the flash copy.  They are looked up after the built-in
+ * coins, so a definition can add a coin but never replace one.
+ */
+
+_Static_assert(sizeof(StorageCoinDefinition) == 112, "coin definition record size is part of the signed format");
+
+static CoinInfo coin_definitions[STORAGE_COIN_DEFINITIONS];
+static uint32_t coin_definitions_count;
+
+void coins_init(void)
+{
+	coin_definitions_count = 0;
+	const StorageCoinDefinitions *defs = storage_getCoinDefinitions();
+	// the flash copy is not trusted to be the table that was checked
+	if (!defs || !coinDefinitionsCheck(defs)) return;
+	for (uint32_t i = 0; i < defs->count; i++) {
+		const StorageCoinDefinition *def = &defs->coins[i];
+		CoinInfo *coin = &coin_definitions[i];
+		coin->coin_name = def->coin_name;
+		coin->coin_shortcut = def->coin_shortcut;
+		coin->maxfee_kb = def->maxfee_kb;
+		coin->signed_message_header = def->signed_message_header;
+		coin->has_address_type = (def->flags & COIN_DEFINITION_ADDRESS_TYPE) != 0;
+		coin->has_address_type_p2sh = (def->flags & COIN_DEFINITION_ADDRESS_TYPE_P2SH) != 0;
+		coin->has_segwit = (def->flags & COIN_DEFINITION_SEGWIT) != 0;
+		coin->has_forkid = (def->flags & COIN_DEFINITION_FORKID) != 0;
+		coin->force_bip143 = (def->flags & COIN_DEFINITION_FORCE_BIP143) != 0;
+		coin->address_type = def->address_type;
+		coin->address_type_p2sh = def->address_type_p2sh;
+		coin->xpub_magic = def->xpub_magic;
+		coin->xprv_magic = def->xprv_magic;
+		coin->forkid = def->forkid;
+		coin->bech32_prefix = def->bech32_prefix[0] ? def->bech32_prefix : NULL;
+		coin->coin_type = def->coin_type;
+		coin->curve_name = SECP256K1_NAME;
+		coin->curve = &secp256k1_info;
+	}
+	coin_definitions_count = defs->count;
+}
+
+// the installed coins, or none once the storage has been wiped
+const CoinInfo *coinDefinitions(uint32_t *count)
+{
+	*count = storage_getCoinDefinitions() ? coin_definitions_count : 0;
+	return coin_definitions;
+}
+
+// sanity checks of a table before it is installed; the signature
+// is checked by the caller
+bool coinDefinitionsCheck(const StorageCoinDefinitions *defs)
+{
+	if (defs->count > STORAGE_COIN_DEFINITIONS) return false;
+	const uint32_t known_flags = COIN_DEFINITION_ADDRESS_TYPE | COIN_DEFINITION_ADDRESS_TYPE_P2SH
+		| COIN_DEFINITION_SEGWIT | COIN_DEFINITION_FORKID | COIN_DEFINITION_FORCE_BIP143;
+	for (uint32_t i = 0; i < defs->count; i++) {
+		const StorageCoinDefinition *def = &defs->coins[i];
+		if (strnlen(def->coin_name, sizeof(def->coin_name)) == sizeof(def->coin_name)) return false;
+		if (strnlen(def->coin_shortcut, sizeof(def->coin_shortcut)) == sizeof(def->coin_shortcut)) return false;
+		if (strnlen(def->signed_message_header, sizeof(def->signed_message_header)) == sizeof(def->signed_message_header)) return false;
+		if (strnlen(def->bech32_prefix, sizeof(def->bech32_prefix)) == sizeof(def->bech32_prefix)) return false;
+		if (def->coin_shortcut[0] != ' ' || def->coin_shortcut[1] == 0) return false;
+		if ((size_t)(uint8_t)def->signed_message_header[0] != strlen(def->signed_message_header + 1)) return false;
+		if (def->flags & ~known_flags) return false;
+		if (def->coin_type < 0x80000000) return false;
+		// strictly ascending, so names are unique and can be bisected
+		if (def->coin_name[0] == 0) return false;
+		if (i > 0 && strcmp(defs->coins[i - 1].coin_name, def->coin_name) >= 0) return false;
+	}
+	return true;
+}
+
 const CoinInfo *coinByName(const char *name)
 {
 	if (!name) return 0;
@@ -38,6 +114,21 @@ const CoinInfo *coinByName(const char *name)
 			return &(coins[i]);
 		}
 	}
+	uint32_t count;
+	const CoinInfo *defs = coinDefinitions(&count);
+	uint32_t lo = 0, hi = count;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		int cmp = strcmp(name, defs[mid].coin_name);
+		if (cmp == 0) {
+			return &(defs[mid]);
+		}
+		if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
 	return 0;
 }
 
@@ -48,6 +139,13 @@ const CoinInfo *coinByAddressType(uint32_t address_type)
 			return &(coins[i]);
 		}
 	}
+	uint32_t count;
+	const CoinInfo *defs = coinDefinitions(&count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (address_type == defs[i].address_type) {
+			return &(defs[i]);
+		}
+	}
 	return 0;
 }
 
@@ -58,6 +156,13 @@ const CoinInfo *coinByCoinType(uint32_t coin_type)
 			return &(coins[i]);
 		}
 	}
+	uint32_t count;
+	const CoinInfo *defs = coinDefinitions(&count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (coin_type == defs[i].coin_type) {
+			return &(defs[i]);
+		}
+	}
 	return 0;
 }
 
@@ -26,6 +26,7 @@
 #include "bip32.h"
 #include "coins_count.h"
 #include "hasher.h"
+#include "storage.h"
 
 typedef struct _CoinInfo {
 	const char *coin_name;
@@ -51,6 +52,10 @@ typedef struct _CoinInfo {
 
 extern const CoinInfo coins[COINS_COUNT];
 
+void coins_init(void);
+const CoinInfo *coinDefinitions(uint32_t *count);
+bool coinDefinitionsCheck(const StorageCoinDefinitions *defs);
+
 const CoinInfo *coinByName(const char *name);
 const CoinInfo *coinByAddressType(uint32_t address_type);
 const CoinInfo *coinByCoinType(uint32_t coin_type);
@@ -33,23 +33,88 @@
 #include "util.h"
 #include "gettext.h"
 #include "ethereum_tokens.h"
+#include "pubkeys.h"
+#include "sha2.h"
 #include "memzero.h"
+#include "timer.h"
 
 /* maximum supported chain id.  v must fit in an uint32_t. */
 #define MAX_CHAIN_ID 2147483630
 
+/* maximum number of transactions confirmed together in one batch.
+ * The fee is multiplied by the count, which must fit in one byte to
+ * keep the fee below the field prime (see ethereum_signing_check). */
+#define MAX_BATCH_COUNT 255
+
+/* a batch is dropped, together with its key, when the next transaction
+ * does not arrive in time */
+#define BATCH_TIMEOUT_MS (60 * 1000)
+
 static bool ethereum_signing = false;
 static uint32_t data_total, data_left;
 static EthereumTxRequest msg_tx_request;
 static CONFIDENTIAL uint8_t privkey[32];
 static uint32_t chain_id;
+
+/* token metadata sent by the host along with the transaction, used for
+ * tokens missing from the built-in table */
+static bool token_def_valid;
+static uint32_t token_def_chain_id;
+static uint8_t token_def_address[20];
+static char token_def_ticker[12];
+static TokenType token_def = { 0, (const char *)token_def_address, token_def_ticker, 0 };
 struct SHA3_CTX keccak_ctx;
 
+/*
+ * Batch state.  The first transaction of a batch is confirmed for the
+ * whole batch and the private key is kept in privkey until the last
+ * transaction is signed.  Every following transaction must spend from
+ * the same account to the same recipient on the same chain, with the
+ * same gas price and limit, no data and the next nonce.
+ */
+static uint32_t batch_left;
+static uint32_t batch_last_ms;
+static uint32_t batch_address_n[8];
+static size_t batch_address_n_count;
+static uint32_t batch_chain_id;
+static uint8_t batch_to[20];
+static EthereumSignTx_gas_price_t batch_gas_price;
+static EthereumSignTx_gas_limit_t batch_gas_limit;
+static bignum256 batch_nonce, batch_value_left;
+
+/*
+ * State of the EthereumTxAck being received.  The data_chunk bytes are
+ * hashed as the packets are reassembled (ethereum_signing_stream) so that
+ * ethereum_signing_txack only has to check that the decoded chunk is the
+ * one that was hashed.
+ */
+static enum {
+	STREAM_OFF,
+	STREAM_TAG,
+	STREAM_LENGTH,
+	STREAM_DATA,
+	STREAM_TAIL,
+	STREAM_MISMATCH,
+} stream_state = STREAM_OFF;
+static uint32_t stream_length, stream_shift, stream_left, stream_hashed;
+static bool stream_poisoned = false;
+/* an EthereumTxRequest for the next chunk was sent and not answered yet,
+ * only the answer to it may be hashed while it is received */
+static bool awaiting_chunk = false;
+
 static inline void hash_data(const uint8_t *buf, size_t size)
 {
 	sha3_Update(&keccak_ctx, buf, size);
 }
 
+static void stream_reset(void)
+{
+	stream_state = STREAM_OFF;
+	stream_hashed = 0;
+	stream_poisoned = false;
+	awaiting_chunk = false;
+}
+
 /*
  * Push an RLP encoded length to the hash buffer.
  */
@@ -164,9 +229,18 @@ static void send_request_chunk(void)
 	layoutProgress(_("Signing"), progress);
 	msg_tx_request.has_data_length = true;
 	msg_tx_request.data_length = data_left <= 1024 ? data_left : 1024;
+	awaiting_chunk = true;
 	msg_write(MessageType_MessageType_EthereumTxRequest, &msg_tx_request);
 }
 
+static void read_be_padded(const uint8_t *data, uint32_t len, bignum256 *out)
+{
+	uint8_t pad_val[32];
+	memset(pad_val, 0, sizeof(pad_val));
+	memcpy(pad_val + (32 - len), data, len);
+	bn_read_be(pad_val, out);
+}
+
 static int ethereum_is_canonic(uint8_t v, uint8_t signature[64])
 {
 	(void) signature;
@@ -194,7 +268,9 @@ static void send_signature(void)
 		return;
 	}
 
-	memzero(privkey, sizeof(privkey));
+	if (batch_left <= 1) {
+		memzero(privkey, sizeof(privkey));
+	}
 
 	/* Send back the result */
 	msg_tx_request.has_data_length = false;
@@ -216,7 +292,16 @@ static void send_signature(void)
 
 	msg_write(MessageType_MessageType_EthereumTxRequest, &msg_tx_request);
 
-	ethereum_signing_abort();
+	if (batch_left > 0) {
+		batch_left--;
+	}
+	if (batch_left > 0) {
+		/* keep privkey for the next transaction of the batch */
+		ethereum_signing = false;
+		batch_last_ms = timer_ms();
+	} else {
+		ethereum_signing_abort();
+	}
 }
 /* Format a 256 bit number (amount in wei) into a human readable format
  * using standard ethereum units.
@@ -260,10 +345,7 @@ static void ethereumFormatAmount(const bignum256 *amnt, const TokenType *token,
 static void layoutEthereumConfirmTx(const uint8_t *to, uint32_t to_len, const uint8_t *value, uint32_t value_len, const TokenType *token)
 {
 	bignum256 val;
-	uint8_t pad_val[32];
-	memset(pad_val, 0, sizeof(pad_val));
-	memcpy(pad_val + (32 - value_len), value, value_len);
-	bn_read_be(pad_val, &val);
+	read_be_padded(value, value_len, &val);
 
 	char amount[32];
 	if (token == NULL) {
@@ -347,27 +429,23 @@ static void layoutEthereumData(const uint8_t *data, uint32_t len, uint32_t total
 static void layoutEthereumFee(const uint8_t *value, uint32_t value_len,
 							  const uint8_t *gas_price, uint32_t gas_price_len,
 							  const uint8_t *gas_limit, uint32_t gas_limit_len,
-							  bool is_token)
+							  uint32_t count, bool is_token)
 {
 	bignum256 val, gas;
-	uint8_t pad_val[32];
 	char tx_value[32];
 	char gas_value[32];
 
-	memset(pad_val, 0, sizeof(pad_val));
-	memcpy(pad_val + (32 - gas_price_len), gas_price, gas_price_len);
-	bn_read_be(pad_val, &val);
-
-	memset(pad_val, 0, sizeof(pad_val));
-	memcpy(pad_val + (32 - gas_limit_len), gas_limit, gas_limit_len);
-	bn_read_be(pad_val, &gas);
+	read_be_padded(gas_price, gas_price_len, &val);
+	read_be_padded(gas_limit, gas_limit_len, &gas);
 	bn_multiply(&val, &gas, &secp256k1.prime);
+	if (count > 1) {
+		bn_read_uint32(count, &val);
+		bn_multiply(&val, &gas, &secp256k1.prime);
+	}
 
 	ethereumFormatAmount(&gas, NULL, gas_value, sizeof(gas_value));
 
-	memset(pad_val, 0, sizeof(pad_val));
-	memcpy(pad_val + (32 - value_len), value, value_len);
-	bn_read_be(pad_val, &val);
+	read_be_padded(value, value_len, &val);
 
 	if (bn_is_zero(&val)) {
 		strcpy(tx_value, is_token ? _("token") : _("message"));
@@ -388,6 +466,41 @@ static void layoutEthereumFee(const uint8_t *value, uint32_t value_len,
 	);
 }
 
+static void layoutEthereumConfirmBatch(uint32_t count, const uint8_t *to, const uint8_t *value, uint32_t value_len)
+{
+	bignum256 val;
+	read_be_padded(value, value_len, &val);
+
+	char title[24];
+	char *p = title;
+	p += strlcpy(title, _("Send "), sizeof(title));
+	bn_format_uint64(count, NULL, _(" transactions"), 0, 0, false, p, sizeof(title) - (p - title));
+
+	char amount[32];
+	ethereumFormatAmount(&val, NULL, amount, sizeof(amount));
+
+	char _to1[] = "to 0x__________";
+	char _to2[] = "_______________";
+	char _to3[] = "_______________?";
+	char to_str[41];
+	ethereum_address_checksum(to, to_str);
+	memcpy(_to1 + 5, to_str, 10);
+	memcpy(_to2, to_str + 10, 15);
+	memcpy(_to3, to_str + 25, 15);
+
+	layoutDialogSwipe(&bmp_icon_question,
+		_("Cancel"),
+		_("Confirm"),
+		NULL,
+		title,
+		amount,
+		_to1,
+		_to2,
+		_to3,
+		NULL
+	);
+}
+
 /*
  * RLP fields:
  * - nonce (0 .. 32)
@@ -422,10 +535,254 @@ static bool ethereum_signing_check(EthereumSignTx *msg)
 	return true;
 }
 
+/*
+ * The first transaction of a batch carries the number of transactions and
+ * their total value.  Data is not allowed, so every transaction is a plain
+ * value transfer that the aggregate confirmation fully describes.
+ */
+static bool ethereum_batch_check_first(const EthereumSignTx *msg)
+{
+	if (msg->batch_count < 2 || msg->batch_count > MAX_BATCH_COUNT) {
+		return false;
+	}
+	if (!msg->has_batch_value || msg->to.size != 20 || data_total != 0) {
+		return false;
+	}
+	if (msg->address_n_count > sizeof(batch_address_n) / sizeof(batch_address_n[0])) {
+		return false;
+	}
+	bignum256 val, total;
+	read_be_padded(msg->value.bytes, msg->value.size, &val);
+	read_be_padded(msg->batch_value.bytes, msg->batch_value.size, &total);
+	return !bn_is_less(&total, &val);
+}
+
+static bool ethereum_batch_check_next(const EthereumSignTx *msg)
+{
+	if (msg->has_batch_count || msg->has_batch_value) {
+		return false;
+	}
+	if (msg->address_n_count != batch_address_n_count ||
+		memcmp(msg->address_n, batch_address_n, batch_address_n_count * sizeof(uint32_t)) != 0) {
+		return false;
+	}
+	if (chain_id != batch_chain_id || data_total != 0) {
+		return false;
+	}
+	if (msg->to.size != 20 || memcmp(msg->to.bytes, batch_to, 20) != 0) {
+		return false;
+	}
+	if (msg->gas_price.size != batch_gas_price.size ||
+		memcmp(msg->gas_price.bytes, batch_gas_price.bytes, batch_gas_price.size) != 0) {
+		return false;
+	}
+	if (msg->gas_limit.size != batch_gas_limit.size ||
+		memcmp(msg->gas_limit.bytes, batch_gas_limit.bytes, batch_gas_limit.size) != 0) {
+		return false;
+	}
+	bignum256 val;
+	read_be_padded(msg->nonce.bytes, msg->nonce.size, &val);
+	if (!bn_is_equal(&val, &batch_nonce)) {
+		return false;
+	}
+	read_be_padded(msg->value.bytes, msg->value.size, &val);
+	if (bn_is_less(&batch_value_left, &val)) {
+		return false;
+	}
+	/* the last transaction must spend exactly what is left */
+	if (batch_left == 1 && !bn_is_equal(&val, &batch_value_left)) {
+		return false;
+	}
+	return true;
+}
+
+static void ethereum_batch_start(const EthereumSignTx *msg)
+{
+	batch_left = msg->batch_count;
+	memcpy(batch_address_n, msg->address_n, msg->address_n_count * sizeof(uint32_t));
+	batch_address_n_count = msg->address_n_count;
+	batch_chain_id = chain_id;
+	memcpy(batch_to, msg->to.bytes, 20);
+	batch_gas_price = msg->gas_price;
+	batch_gas_limit = msg->gas_limit;
+	read_be_padded(msg->batch_value.bytes, msg->batch_value.size, &batch_value_left);
+	read_be_padded(msg->nonce.bytes, msg->nonce.size, &batch_nonce);
+}
+
+/*
+ * Account the transaction about to be signed against the batch: the next
+ * one must use the following nonce and can spend at most the rest.
+ */
+static void ethereum_batch_advance(const EthereumSignTx *msg)
+{
+	bignum256 val;
+	read_be_padded(msg->value.bytes, msg->value.size, &val);
+	bn_subtract(&batch_value_left, &val, &batch_value_left);
+	bn_addi(&batch_nonce, 1);
+}
+
+/*
+ * Check a token definition and make it available to the confirmation.
+ * It is signed like the other definitions (see pubkeys.c), over
+ * SHA256('TRTK' || chain_id || address || decimals || symbol), with
+ * chain_id and decimals as 32-bit little-endian.
+ */
+static bool ethereum_token_definition(const EthereumTokenDefinition *def)
+{
+	if (!def->has_chain_id || !def->has_address || def->address.size != 20 || !def->has_symbol || !def->has_decimals) {
+		return false;
+	}
+	size_t len = strlen(def->symbol);
+	if (len == 0 || len + 2 > sizeof(token_def_ticker)) {
+		return false;
+	}
+	for (size_t i = 0; i < len; i++) {
+		if (def->symbol[i] <= ' ' || def->symbol[i] > '~') {
+			return false;
+		}
+	}
+	/* the amount has to fit the confirmation screen */
+	if (def->decimals > 18) {
+		return false;
+	}
+	if (def->signature_indexes_count != PUBKEY_SIGNATURES || def->signatures_count != PUBKEY_SIGNATURES) {
+		return false;
+	}
+
+	uint8_t chain_id[4], decimals[4];
+	uint32le(def->chain_id, chain_id);
+	uint32le(def->decimals, decimals);
+	uint8_t hash[32];
+	SHA256_CTX ctx;
+	sha256_Init(&ctx);
+	sha256_Update(&ctx, (const uint8_t *)"TRTK", 4);
+	sha256_Update(&ctx, chain_id, sizeof(chain_id));
+	sha256_Update(&ctx, def->address.bytes, 20);
+	sha256_Update(&ctx, decimals, sizeof(decimals));
+	sha256_Update(&ctx, (const uint8_t *)def->symbol, len);
+	sha256_Final(&ctx, hash);
+
+	const uint8_t *signatures[PUBKEY_SIGNATURES];
+	for (int i = 0; i < PUBKEY_SIGNATURES; i++) {
+		if (def->signatures[i].size != 64) {
+			return false;
+		}
+		signatures[i] = def->signatures[i].bytes;
+	}
+	if (!pubkeys_verify(hash, def->signature_indexes, signatures)) {
+		return false;
+	}
+
+	token_def_chain_id = def->chain_id;
+	memcpy(token_def_address, def->address.bytes, 20);
+	token_def_ticker[0] = ' ';
+	strlcpy(token_def_ticker + 1, def->symbol, sizeof(token_def_ticker) - 1);
+	token_def.chain_id = def->chain_id;
+	token_def.decimals = def->decimals;
+	token_def_valid = true;
+	return true;
+}
+
+/*
+ * Confirm a single transaction: recipient and value, data and fee.
+ */
+static bool ethereum_signing_confirm(const EthereumSignTx *msg)
+{
+	const TokenType *token = NULL;
+
+	// detect ERC-20 token
+	if (msg->to.size == 20 && msg->value.size == 0 && data_total == 68 && msg->data_initial_chunk.size == 68
+	    && memcmp(msg->data_initial_chunk.bytes, "\xa9\x05\x9c\xbb\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 16) == 0) {
+		token = tokenByChainAddress(chain_id, msg->to.bytes);
+		if (token == UnknownToken && token_def_valid && token_def_chain_id == chain_id
+		    && memcmp(token_def_address, msg->to.bytes, 20) == 0) {
+			token = &token_def;
+		}
+	}
+
+	if (token != NULL) {
+		layoutEthereumConfirmTx(msg->data_initial_chunk.bytes + 16, 20, msg->data_initial_chunk.bytes + 36, 32, token);
+	} else {
+		layoutEthereumConfirmTx(msg->to.bytes, msg->to.size, msg->value.bytes, msg->value.size, NULL);
+	}
+
+	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
+		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+		ethereum_signing_abort();
+		return false;
+	}
+
+	if (token == NULL && data_total > 0) {
+		layoutEthereumData(msg->data_initial_chunk.bytes, msg->data_initial_chunk.size, data_total);
+		if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
+			fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+			ethereum_signing_abort();
+			return false;
+		}
+	}
+
+	layoutEthereumFee(msg->value.bytes, msg->value.size,
+					  msg->gas_price.bytes, msg->gas_price.size,
+					  msg->gas_limit.bytes, msg->gas_limit.size, 1, token != NULL);
+	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
+		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+		ethereum_signing_abort();
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Confirm a whole batch: number of transactions, total value and the
+ * fee of all of them together.
+ */
+static bool ethereum_batch_confirm(const EthereumSignTx *msg)
+{
+	layoutEthereumConfirmBatch(msg->batch_count, msg->to.bytes, msg->batch_value.bytes, msg->batch_value.size);
+	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
+		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+		ethereum_signing_abort();
+		return false;
+	}
+	layoutEthereumFee(msg->batch_value.bytes, msg->batch_value.size,
+					  msg->gas_price.bytes, msg->gas_price.size,
+					  msg->gas_limit.bytes, msg->gas_limit.size, msg->batch_count, false);
+	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
+		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+		ethereum_signing_abort();
+		return false;
+	}
+	return true;
+}
+
+bool ethereum_signing_batch_pending(void)
+{
+	if (batch_left > 0 && !ethereum_signing && timer_ms() - batch_last_ms > BATCH_TIMEOUT_MS) {
+		ethereum_signing_abort();
+	}
+	return batch_left > 0 && !ethereum_signing;
+}
+
+/*
+ * node is NULL for the next transaction of a pending batch, whose key is
+ * kept in privkey.  The caller decides this with
+ * ethereum_signing_batch_pending(), so the batch cannot time out in
+ * between.
+ */
 void ethereum_signing_init(EthereumSignTx *msg, const HDNode *node)
 {
+	const bool batch_next = (node == NULL);
+	if (batch_next && batch_left == 0) {
+		fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("No batch in progress"));
+		ethereum_signing_abort();
+		return;
+	}
+
 	ethereum_signing = true;
+	data_total = 0;
+	data_left = 0;
 	sha3_256_Init(&keccak_ctx);
+	stream_reset();
 
 	memset(&msg_tx_request, 0, sizeof(EthereumTxRequest));
 	/* set fields to 0, to avoid conditions later */
@@ -481,44 +838,41 @@ void ethereum_signing_init(EthereumSignTx *msg, const HDNode *node)
 		return;
 	}
 
-	const TokenType *token = NULL;
-
-	// detect ERC-20 token
-	if (msg->to.size == 20 && msg->value.size == 0 && data_total == 68 && msg->data_initial_chunk.size == 68
-	    && memcmp(msg->data_initial_chunk.bytes, "\xa9\x05\x9c\xbb\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 16) == 0) {
-		token = tokenByChainAddress(chain_id, msg->to.bytes);
-	}
-
-	if (token != NULL) {
-		layoutEthereumConfirmTx(msg->data_initial_chunk.bytes + 16, 20, msg->data_initial_chunk.bytes + 36, 32, token);
-	} else {
-		layoutEthereumConfirmTx(msg->to.bytes, msg->to.size, msg->value.bytes, msg->value.size, NULL);
-	}
-
-	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
-		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+	token_def_valid = false;
+	if (msg->has_token && !ethereum_token_definition(&msg->token)) {
+		fsm_sendFailure(FailureType_Failure_DataError, _("Invalid token definition"));
 		ethereum_signing_abort();
 		return;
 	}
 
-	if (token == NULL && data_total > 0) {
-		layoutEthereumData(msg->data_initial_chunk.bytes, msg->data_initial_chunk.size, data_total);
-		if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
-			fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+	if (batch_next) {
+		/* confirmed together with the first transaction of the batch */
+		if (!ethereum_batch_check_next(msg)) {
+			fsm_sendFailure(FailureType_Failure_DataError, _("Transaction does not match batch"));
+			ethereum_signing_abort();
+			return;
+		}
+	} else if (msg->has_batch_count) {
+		if (!ethereum_batch_check_first(msg)) {
+			fsm_sendFailure(FailureType_Failure_DataError, _("Invalid batch"));
 			ethereum_signing_abort();
 			return;
 		}
+		if (!ethereum_batch_confirm(msg)) {
+			return;
+		}
+		ethereum_batch_start(msg);
+	} else if (!ethereum_signing_confirm(msg)) {
+		return;
 	}
 
-	layoutEthereumFee(msg->value.bytes, msg->value.size,
-					  msg->gas_price.bytes, msg->gas_price.size,
-					  msg->gas_limit.bytes, msg->gas_limit.size, token != NULL);
-	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
-		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
-		ethereum_signing_abort();
-		return;
+	if (batch_left > 0) {
+		ethereum_batch_advance(msg);
 	}
-	
+	if (!batch_next) {
+		memcpy(privkey, node->private_key, 32);
+	}
+
 	/* Stage 1: Calculate total RLP length */
 	uint32_t rlp_length = 0;
 
@@ -550,8 +904,6 @@ void ethereum_signing_init(EthereumSignTx *msg, const HDNode *node)
 	hash_data(msg->data_initial_chunk.bytes, msg->data_initial_chunk.size);
 	data_left = data_total - msg->data_initial_chunk.size;
 
-	memcpy(privkey, node->private_key, 32);
-
 	if (data_left > 0) {
 		send_request_chunk();
 	} else {
@@ -559,6 +911,77 @@ void ethereum_signing_init(EthereumSignTx *msg, const HDNode *node)
 	}
 }
 
+void ethereum_signing_stream_begin(void)
+{
+	if (stream_hashed > 0) {
+		/* the previous chunk was hashed but never acknowledged */
+		stream_poisoned = true;
+	}
+	stream_hashed = 0;
+	stream_state = (ethereum_signing && awaiting_chunk && data_left > 0 && !stream_poisoned) ? STREAM_TAG : STREAM_OFF;
+}
+
+/*
+ * Hash the data_chunk of an EthereumTxAck while it is being received.
+ * Only a message consisting of exactly one data_chunk field is hashed;
+ * anything else is left to ethereum_signing_txack.
+ */
+void ethereum_signing_stream(const uint8_t *buf, uint32_t len)
+{
+	while (len > 0) {
+		switch (stream_state) {
+			case STREAM_OFF:
+			case STREAM_MISMATCH:
+				return;
+			case STREAM_TAG:
+				/* field 1 (data_chunk), wire type 2 */
+				if (*buf != 0x0a) {
+					stream_state = STREAM_OFF;
+					return;
+				}
+				stream_length = 0;
+				stream_shift = 0;
+				stream_state = STREAM_LENGTH;
+				break;
+			case STREAM_LENGTH:
+				stream_length |= (uint32_t)(*buf & 0x7f) << stream_shift;
+				stream_shift += 7;
+				if (*buf & 0x80) {
+					if (stream_shift >= 28) {
+						stream_state = STREAM_OFF;
+						return;
+					}
+					break;
+				}
+				if (stream_length == 0 || stream_length > data_left || stream_length > 1024) {
+					stream_state = STREAM_OFF;
+					return;
+				}
+				stream_left = stream_length;
+				stream_state = STREAM_DATA;
+				break;
+			case STREAM_DATA: {
+				uint32_t n = len < stream_left ? len : stream_left;
+				hash_data(buf, n);
+				stream_hashed += n;
+				stream_left -= n;
+				buf += n;
+				len -= n;
+				if (stream_left == 0) {
+					stream_state = STREAM_TAIL;
+				}
+				continue;
+			}
+			case STREAM_TAIL:
+				/* more fields after the hashed chunk */
+				stream_state = STREAM_MISMATCH;
+				return;
+		}
+		buf++;
+		len--;
+	}
+}
+
 void ethereum_signing_txack(EthereumTxAck *tx)
 {
 	if (!ethereum_signing) {
@@ -567,6 +990,22 @@ void ethereum_signing_txack(EthereumTxAck *tx)
 		return;
 	}
 
+	if (!awaiting_chunk) {
+		fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("Data chunk not requested"));
+		ethereum_signing_abort();
+		return;
+	}
+	awaiting_chunk = false;
+
+	uint32_t hashed = stream_hashed;
+	stream_hashed = 0;
+	if (stream_poisoned || stream_state == STREAM_MISMATCH || (hashed > 0 && hashed != tx->data_chunk.size)) {
+		fsm_sendFailure(FailureType_Failure_DataError, _("Data chunk mismatch"));
+		ethereum_signing_abort();
+		return;
+	}
+	stream_state = STREAM_OFF;
+
 	if (tx->data_chunk.size > data_left) {
 		fsm_sendFailure(FailureType_Failure_DataError, _("Too much data"));
 		ethereum_signing_abort();
@@ -579,7 +1018,9 @@ void ethereum_signing_txack(EthereumTxAck *tx)
 		return;
 	}
 
-	hash_data(tx->data_chunk.bytes, tx->data_chunk.size);
+	if (hashed == 0) {
+		hash_data(tx->data_chunk.bytes, tx->data_chunk.size);
+	}
 
 	data_left -= tx->data_chunk.size;
 
@@ -592,11 +1033,15 @@ void ethereum_signing_txack(EthereumTxAck *tx)
 
 void ethereum_signing_abort(void)
 {
-	if (ethereum_signing) {
+	if (ethereum_signing || batch_left > 0) {
 		memzero(privkey, sizeof(privkey));
 		layoutHome();
 		ethereum_signing = false;
+		batch_left = 0;
 	}
+	data_total = 0;
+	data_left = 0;
+	stream_reset();
 }
 
 static void ethereum_message_hash(const uint8_t *message, size_t message_len, uint8_t hash[32])
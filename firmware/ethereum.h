@@ -27,7 +27,10 @@
 
 void ethereum_signing_init(EthereumSignTx *msg, const HDNode *node);
 void ethereum_signing_abort(void);
+bool ethereum_signing_batch_pending(void);
 void ethereum_signing_txack(EthereumTxAck *msg);
+void ethereum_signing_stream_begin(void);
+void ethereum_signing_stream(const uint8_t *buf, uint32_t len);
 
 void ethereum_message_sign(EthereumSignMessage *msg, const HDNode *node, EthereumMessageSignature *resp);
 int ethereum_message_verify(EthereumVerifyMessage *msg);
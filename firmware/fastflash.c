@@ -18,6 +18,7 @@
  */
 
 #include "fastflash.h"
+#include "memory.h"
 #include "util.h"
 
 #include <stdbool.h>
@@ -37,5 +38,9 @@ void __attribute__((noreturn)) run_bootloader(void)
 	// copy bootloader
 	memcpy(bootloader_vec, __bootloader_start__, (size_t) __bootloader_size__);
 
+	// tell the bootloader to accept the firmware upload right away
+	FASTFLASH_MAILBOX->magic = FASTFLASH_MAILBOX_MAGIC;
+	FASTFLASH_MAILBOX->flags = FASTFLASH_FLAG_OPEN;
+
 	load_vector_table(bootloader_vec);
 }
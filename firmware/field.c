@@ -0,0 +1,303 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2014 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "field.h"
+#include "secp256k1.h"
+#include "nist256p1.h"
+#include "memzero.h"
+
+/*
+ * Multiplication modulo the secp256k1 and nist256p1 primes.
+ *
+ * The generic bn_multiply computes the 540 bit product in 30 bit limbs
+ * and then reduces it with nine estimated quotient steps, each another
+ * 9x9 limb multiplication.  Both primes have a sparse form that allows
+ * the reduction to be done with a few additions instead:
+ *
+ *   secp256k1: 2^256 = 2^32 + 977                 (mod p)
+ *   nist256p1: 2^256 = 2^224 - 2^192 - 2^96 + 1   (mod p)
+ *
+ * The operands are converted to 32 bit words, multiplied (64 word
+ * products instead of 81 limb products, 36 for a square) and reduced to
+ * a value below 2^256.  There are no branches or memory accesses that
+ * depend on the values.
+ */
+
+#define LIMB_BITS 30
+#define LIMB_MASK 0x3FFFFFFFu
+
+// w[0..8] := x in 32 bit words, w[8] holds the bits above 2^256
+static void field_unpack(const bignum256 *x, uint32_t w[9])
+{
+	uint64_t acc = 0;
+	int bits = 0, j = 0;
+	for (int i = 0; i < 9; i++) {
+		acc += (uint64_t)x->val[i] << bits;
+		bits += LIMB_BITS;
+		if (bits >= 32) {
+			w[j++] = (uint32_t)acc;
+			acc >>= 32;
+			bits -= 32;
+		}
+	}
+	w[8] = (uint32_t)acc;
+}
+
+// x := w, normalized
+static void field_pack(const uint32_t w[8], bignum256 *x)
+{
+	uint64_t acc = 0;
+	int bits = 0, j = 0;
+	for (int i = 0; i < 8; i++) {
+		acc |= (uint64_t)w[i] << bits;
+		bits += 32;
+		if (bits >= LIMB_BITS) {
+			x->val[j++] = acc & LIMB_MASK;
+			acc >>= LIMB_BITS;
+			bits -= LIMB_BITS;
+		}
+	}
+	x->val[8] = (uint32_t)acc;
+}
+
+// r := a * b
+static void field_mul_words(const uint32_t a[8], const uint32_t b[8], uint32_t r[16])
+{
+	for (int i = 0; i < 8; i++) {
+		r[i] = 0;
+	}
+	for (int i = 0; i < 8; i++) {
+		uint64_t c = 0;
+		for (int j = 0; j < 8; j++) {
+			// no overflow, since (2^32 - 1)^2 + 2 * (2^32 - 1) < 2^64
+			c += (uint64_t)a[i] * b[j] + r[i + j];
+			r[i + j] = (uint32_t)c;
+			c >>= 32;
+		}
+		r[i + 8] = (uint32_t)c;
+	}
+}
+
+// r := a * a
+static void field_sqr_words(const uint32_t a[8], uint32_t r[16])
+{
+	// products a[i] * a[j] with i < j
+	for (int i = 0; i < 16; i++) {
+		r[i] = 0;
+	}
+	for (int i = 0; i < 7; i++) {
+		uint64_t c = 0;
+		for (int j = i + 1; j < 8; j++) {
+			c += (uint64_t)a[i] * a[j] + r[i + j];
+			r[i + j] = (uint32_t)c;
+			c >>= 32;
+		}
+		r[i + 8] = (uint32_t)c;
+	}
+	// each of them appears twice
+	uint32_t top = 0;
+	for (int i = 0; i < 16; i++) {
+		uint32_t t = r[i];
+		r[i] = (t << 1) | top;
+		top = t >> 31;
+	}
+	// plus the squares a[i] * a[i]
+	uint64_t c = 0;
+	for (int i = 0; i < 8; i++) {
+		uint64_t s = (uint64_t)a[i] * a[i];
+		c += (uint64_t)r[2 * i] + (uint32_t)s;
+		r[2 * i] = (uint32_t)c;
+		c >>= 32;
+		c += (uint64_t)r[2 * i + 1] + (s >> 32);
+		r[2 * i + 1] = (uint32_t)c;
+		c >>= 32;
+	}
+}
+
+// w := w + k * 2^256 (mod p), k < 2^33, result below 2^256
+static void field_secp256k1_fold(uint32_t w[8], uint64_t k)
+{
+	// the second round adds at most 2^32 + 977 to a value below 2^66
+	for (int round = 0; round < 2; round++) {
+		uint64_t c = (uint64_t)w[0] + k * 977;
+		w[0] = (uint32_t)c;
+		c >>= 32;
+		c += (uint64_t)w[1] + k;
+		w[1] = (uint32_t)c;
+		c >>= 32;
+		for (int i = 2; i < 8; i++) {
+			c += w[i];
+			w[i] = (uint32_t)c;
+			c >>= 32;
+		}
+		k = c;
+	}
+}
+
+// w := r (mod p), below 2^256
+static void field_secp256k1_reduce(const uint32_t r[16], uint32_t w[8])
+{
+	// w := low + high * 977 + (high << 32)
+	uint64_t c = 0;
+	for (int i = 0; i < 8; i++) {
+		c += (uint64_t)r[i] + (uint64_t)r[8 + i] * 977;
+		if (i > 0) {
+			c += r[7 + i];
+		}
+		w[i] = (uint32_t)c;
+		c >>= 32;
+	}
+	// the carry is below 2^33
+	field_secp256k1_fold(w, c + r[15]);
+}
+
+// w := w + k * 2^256 (mod p), |k| < 2^32, result below 2^256
+static void field_nist256p1_fold(uint32_t w[8], int64_t k)
+{
+	// 2^256 = 2^224 - 2^192 - 2^96 + 1
+	static const int64_t coef[8] = { 1, 0, 0, -1, 0, 0, -1, 1 };
+	// the carry is at most one after the first round, and after the
+	// second round if the first one left a value just below 2^256
+	for (int round = 0; round < 3; round++) {
+		int64_t c = 0;
+		for (int i = 0; i < 8; i++) {
+			c += (int64_t)w[i] + coef[i] * k;
+			w[i] = (uint32_t)c;
+			c >>= 32; // arithmetic shift, c may be negative
+		}
+		k = c;
+	}
+}
+
+// w := r (mod p), below 2^256
+static void field_nist256p1_reduce(const uint32_t r[16], uint32_t w[8])
+{
+	// FIPS 186-4, D.2.3: T + 2 S1 + 2 S2 + S3 + S4 - D1 - D2 - D3 - D4
+	const int64_t c8 = r[8], c9 = r[9], c10 = r[10], c11 = r[11];
+	const int64_t c12 = r[12], c13 = r[13], c14 = r[14], c15 = r[15];
+	int64_t s[8];
+	s[0] = r[0] + c8 + c9 - c11 - c12 - c13 - c14;
+	s[1] = r[1] + c9 + c10 - c12 - c13 - c14 - c15;
+	s[2] = r[2] + c10 + c11 - c13 - c14 - c15;
+	s[3] = r[3] + 2 * c11 + 2 * c12 + c13 - c15 - c8 - c9;
+	s[4] = r[4] + 2 * c12 + 2 * c13 + c14 - c9 - c10;
+	s[5] = r[5] + 2 * c13 + 2 * c14 + c15 - c10 - c11;
+	s[6] = r[6] + 3 * c14 + 2 * c15 + c13 - c8 - c9;
+	s[7] = r[7] + 3 * c15 + c8 - c10 - c11 - c12 - c13;
+
+	int64_t c = 0;
+	for (int i = 0; i < 8; i++) {
+		c += s[i];
+		w[i] = (uint32_t)c;
+		c >>= 32;
+	}
+	// the carry is between -4 and 6
+	field_nist256p1_fold(w, c);
+}
+
+void field_secp256k1_multiply(const bignum256 *k, bignum256 *x)
+{
+	uint32_t a[9], b[9], r[16];
+	field_unpack(k, a);
+	field_secp256k1_fold(a, a[8]);
+	field_unpack(x, b);
+	field_secp256k1_fold(b, b[8]);
+	field_mul_words(a, b, r);
+	field_secp256k1_reduce(r, a);
+	field_pack(a, x);
+	memzero(a, sizeof(a));
+	memzero(b, sizeof(b));
+	memzero(r, sizeof(r));
+}
+
+void field_secp256k1_square(bignum256 *x)
+{
+	uint32_t a[9], r[16];
+	field_unpack(x, a);
+	field_secp256k1_fold(a, a[8]);
+	field_sqr_words(a, r);
+	field_secp256k1_reduce(r, a);
+	field_pack(a, x);
+	memzero(a, sizeof(a));
+	memzero(r, sizeof(r));
+}
+
+void field_nist256p1_multiply(const bignum256 *k, bignum256 *x)
+{
+	uint32_t a[9], b[9], r[16];
+	field_unpack(k, a);
+	field_nist256p1_fold(a, a[8]);
+	field_unpack(x, b);
+	field_nist256p1_fold(b, b[8]);
+	field_mul_words(a, b, r);
+	field_nist256p1_reduce(r, a);
+	field_pack(a, x);
+	memzero(a, sizeof(a));
+	memzero(b, sizeof(b));
+	memzero(r, sizeof(r));
+}
+
+void field_nist256p1_square(bignum256 *x)
+{
+	uint32_t a[9], r[16];
+	field_unpack(x, a);
+	field_nist256p1_fold(a, a[8]);
+	field_sqr_words(a, r);
+	field_nist256p1_reduce(r, a);
+	field_pack(a, x);
+	memzero(a, sizeof(a));
+	memzero(r, sizeof(r));
+}
+
+bool field_multiply(const bignum256 *k, bignum256 *x, const bignum256 *prime)
+{
+	if (prime == &secp256k1.prime) {
+		if (k == x) {
+			field_secp256k1_square(x);
+		} else {
+			field_secp256k1_multiply(k, x);
+		}
+		return true;
+	}
+	if (prime == &nist256p1.prime) {
+		if (k == x) {
+			field_nist256p1_square(x);
+		} else {
+			field_nist256p1_multiply(k, x);
+		}
+		return true;
+	}
+	return false;
+}
+
+#if SPECIALIZED_FIELD
+
+// the firmware is linked with -Wl,--wrap=bn_multiply, so every call of
+// bn_multiply outside of bignum.c ends up here
+void __real_bn_multiply(const bignum256 *k, bignum256 *x, const bignum256 *prime);
+void __wrap_bn_multiply(const bignum256 *k, bignum256 *x, const bignum256 *prime);
+
+void __wrap_bn_multiply(const bignum256 *k, bignum256 *x, const bignum256 *prime)
+{
+	if (!field_multiply(k, x, prime)) {
+		__real_bn_multiply(k, x, prime);
+	}
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2014 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FIELD_H__
+#define __FIELD_H__
+
+#include <stdbool.h>
+#include "bignum.h"
+
+// x := k * x (mod p) for p = secp256k1.prime and p = nist256p1.prime,
+// with the contract of bn_multiply: the limbs of k and x are below 2^32,
+// the result is normalized and below 2^256 (so below 2 * p).
+// k may be the same as x.
+void field_secp256k1_multiply(const bignum256 *k, bignum256 *x);
+void field_secp256k1_square(bignum256 *x);
+void field_nist256p1_multiply(const bignum256 *k, bignum256 *x);
+void field_nist256p1_square(bignum256 *x);
+
+// specialized bn_multiply, returns false for any other prime
+bool field_multiply(const bignum256 *k, bignum256 *x, const bignum256 *prime);
+
+#endif
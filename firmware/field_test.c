@@ -0,0 +1,222 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2014 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks field.c against the generic bn_multiply and measures both.
+ * Emulator only:
+ *
+ *   make -C firmware EMULATOR=1 field_test
+ *   firmware/field_test [iterations [seed]]   randomized differential test
+ *   firmware/field_test bench                 cycles per operation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "field.h"
+#include "bignum.h"
+#include "secp256k1.h"
+#include "nist256p1.h"
+
+#define LIMB_MASK 0x3FFFFFFFu
+
+static const struct {
+	const char *name;
+	const bignum256 *prime;
+} primes[] = {
+	{ "secp256k1", &secp256k1.prime },
+	{ "nist256p1", &nist256p1.prime },
+};
+
+static uint64_t rng_state;
+
+static uint32_t rng32(void)
+{
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+// x := multiple * prime + delta, normalized
+static void prime_multiple(bignum256 *x, const bignum256 *prime, uint32_t multiple, int32_t delta)
+{
+	int64_t c = delta;
+	for (int i = 0; i < 8; i++) {
+		c += (int64_t)prime->val[i] * multiple;
+		x->val[i] = c & LIMB_MASK;
+		c >>= 30;
+	}
+	x->val[8] = prime->val[8] * multiple + c;
+}
+
+// one of the operands bn_multiply is called with: below 180 * prime,
+// with the limbs below 2^30
+static void random_operand(bignum256 *x, const bignum256 *prime)
+{
+	static const struct {
+		uint32_t multiple;
+		int32_t delta;
+	} edges[] = {
+		{ 0, 0 }, { 0, 1 }, { 1, -1 }, { 1, 0 }, { 1, 1 }, { 2, -1 }, { 179, 0 },
+	};
+	uint32_t kind = rng32() % 8;
+	if (kind == 0) {
+		uint32_t e = rng32() % (sizeof(edges) / sizeof(edges[0]));
+		prime_multiple(x, prime, edges[e].multiple, edges[e].delta);
+		return;
+	}
+	for (int i = 0; i < 9; i++) {
+		switch (kind) {
+			case 1: // carry chains
+				x->val[i] = (rng32() & 1) ? LIMB_MASK : 0;
+				break;
+			default:
+				x->val[i] = rng32() & LIMB_MASK;
+				break;
+		}
+	}
+	// below 2^256, the usual case, or below 2^263 < 180 * prime
+	x->val[8] &= (kind < 6) ? 0xFFFF : 0x7FFFFF;
+}
+
+static bool field_check(const bignum256 *prime, const bignum256 *k, const bignum256 *x, bool square)
+{
+	bignum256 generic = *x, specialized = *x;
+	if (square) {
+		bn_multiply(&generic, &generic, prime);
+		field_multiply(&specialized, &specialized, prime);
+	} else {
+		bn_multiply(k, &generic, prime);
+		field_multiply(k, &specialized, prime);
+	}
+	// normalized and below 2^256
+	for (int i = 0; i < 8; i++) {
+		if (specialized.val[i] > LIMB_MASK) {
+			return false;
+		}
+	}
+	if (specialized.val[8] > 0xFFFF) {
+		return false;
+	}
+	bn_mod(&generic, prime);
+	bn_mod(&specialized, prime);
+	return bn_is_equal(&generic, &specialized);
+}
+
+static void field_print(const char *label, const bignum256 *x)
+{
+	printf("  %s:", label);
+	for (int i = 8; i >= 0; i--) {
+		printf(" %08x", x->val[i]);
+	}
+	printf("\n");
+}
+
+static int field_test(uint32_t iterations)
+{
+	int failures = 0;
+	for (size_t p = 0; p < sizeof(primes) / sizeof(primes[0]); p++) {
+		int mismatches = 0;
+		for (uint32_t i = 0; i < iterations; i++) {
+			bignum256 k, x;
+			random_operand(&k, primes[p].prime);
+			random_operand(&x, primes[p].prime);
+			bool square = (i % 4) == 0;
+			if (!field_check(primes[p].prime, &k, &x, square)) {
+				printf("%s %s mismatch\n", primes[p].name, square ? "square" : "multiply");
+				if (!square) {
+					field_print("k", &k);
+				}
+				field_print("x", &x);
+				mismatches++;
+			}
+		}
+		printf("%s: %u operations, %d mismatches\n", primes[p].name, iterations, mismatches);
+		failures += mismatches;
+	}
+	return failures == 0 ? 0 : 1;
+}
+
+static uint64_t field_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __rdtsc();
+#else
+	// no cycle counter, report nanoseconds
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#define BENCH_ROUNDS 100000
+
+static uint64_t field_bench_one(const bignum256 *prime, bool specialized, bool square)
+{
+	bignum256 k, x;
+	random_operand(&k, prime);
+	random_operand(&x, prime);
+	uint64_t start = field_cycles();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		const bignum256 *factor = square ? &x : &k;
+		if (specialized) {
+			field_multiply(factor, &x, prime);
+		} else {
+			bn_multiply(factor, &x, prime);
+		}
+	}
+	uint64_t cycles = (field_cycles() - start) / BENCH_ROUNDS;
+	// keep the chain of results alive
+	if (x.val[0] == 0xFFFFFFFF) {
+		printf("\n");
+	}
+	return cycles;
+}
+
+static int field_bench(void)
+{
+	for (size_t p = 0; p < sizeof(primes) / sizeof(primes[0]); p++) {
+		for (int square = 0; square <= 1; square++) {
+			uint64_t generic = field_bench_one(primes[p].prime, false, square);
+			uint64_t specialized = field_bench_one(primes[p].prime, true, square);
+			printf("%s %-8s generic %6u  specialized %6u  cycles/op\n",
+				primes[p].name, square ? "square" : "multiply",
+				(unsigned)generic, (unsigned)specialized);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	rng_state = (argc > 2) ? strtoull(argv[2], NULL, 0) : (uint64_t)time(NULL);
+	rng_state |= 1;
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		return field_bench();
+	}
+	printf("seed %llu\n", (unsigned long long)rng_state);
+	return field_test((argc > 1) ? strtoul(argv[1], NULL, 0) : 100000);
+}
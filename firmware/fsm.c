@@ -42,17 +42,22 @@
 #include "usb.h"
 #include "util.h"
 #include "signing.h"
+#include "policy.h"
 #include "aes/aes.h"
 #include "hmac.h"
 #include "crypto.h"
+#include "pubkeys.h"
 #include "base58.h"
 #include "bip39.h"
 #include "ripemd160.h"
+#include "sha2.h"
 #include "curves.h"
 #include "secp256k1.h"
 #include "ethereum.h"
+#if USE_NEM
 #include "nem.h"
 #include "nem2.h"
+#endif
 #include "rfc6979.h"
 #include "gettext.h"
 
@@ -233,10 +238,71 @@ static bool fsm_layoutAddress(const char *address, const char *desc, bool ignore
 	}
 }
 
+static void fsm_fillCoinType(CoinType *resp, const CoinInfo *coin)
+{
+	if (coin->coin_name) {
+		resp->has_coin_name = true;
+		strlcpy(resp->coin_name, coin->coin_name, sizeof(resp->coin_name));
+	}
+	if (coin->coin_shortcut) {
+		resp->has_coin_shortcut = true;
+		strlcpy(resp->coin_shortcut, coin->coin_shortcut + 1, sizeof(resp->coin_shortcut));
+	}
+	resp->has_address_type = coin->has_address_type;
+	resp->address_type = coin->address_type;
+	resp->has_maxfee_kb = true;
+	resp->maxfee_kb = coin->maxfee_kb;
+	resp->has_address_type_p2sh = coin->has_address_type_p2sh;
+	resp->address_type_p2sh = coin->address_type_p2sh;
+	resp->has_xpub_magic = coin->xpub_magic != 0;
+	resp->xpub_magic = coin->xpub_magic;
+	resp->has_xprv_magic = coin->xprv_magic != 0;
+	resp->xprv_magic = coin->xprv_magic;
+	resp->has_segwit = true;
+	resp->segwit = coin->has_segwit;
+	resp->has_forkid = coin->has_forkid;
+	resp->forkid = coin->forkid;
+	resp->has_force_bip143 = true;
+	resp->force_bip143 = coin->force_bip143;
+}
+
+// called for every message processed outside of tiny mode; a reset or
+// recovery waiting for its next message ends when a message arrives that
+// writes the storage or starts another setup, so that its changes are
+// not staged in the open storage transaction.  Queries such as Ping and
+// GetFeatures leave it running.
+void fsm_abortInterruptedWorkflow(uint16_t msg_id)
+{
+	switch (msg_id) {
+		case MessageType_MessageType_ResetDevice:
+		case MessageType_MessageType_RecoveryDevice:
+		case MessageType_MessageType_BackupDevice:
+		case MessageType_MessageType_LoadDevice:
+		case MessageType_MessageType_WipeDevice:
+		case MessageType_MessageType_ChangePin:
+		case MessageType_MessageType_ApplySettings:
+		case MessageType_MessageType_ApplyFlags:
+		case MessageType_MessageType_ApplyPolicy:
+		case MessageType_MessageType_LoadCoinDefinitions:
+		case MessageType_MessageType_SetU2FCounter:
+			recovery_abort();
+			reset_abort();
+			break;
+		default:
+			break;
+	}
+}
+
 void fsm_msgInitialize(Initialize *msg)
 {
 	recovery_abort();
-	signing_abort();
+	reset_abort();
+	// the host may reconnect after a transport failure and resume signing
+	signing_suspend();
+	storage_abort();
+#if USE_ETHEREUM
+	ethereum_signing_abort();
+#endif
 	if (msg && msg->has_state && msg->state.size == 64) {
 		uint8_t i_state[64];
 		if (!session_getState(msg->state.bytes, i_state, NULL)) {
@@ -278,34 +344,18 @@ void fsm_msgGetFeatures(GetFeatures *msg)
 		strlcpy(resp->label, storage_getLabel(), sizeof(resp->label));
 	}
 	
-	_Static_assert(pb_arraysize(Features, coins) >= COINS_COUNT, "Features.coins max_count not large enough");
+	_Static_assert(pb_arraysize(Features, coins) >= STORAGE_COIN_DEFINITIONS + COINS_COUNT, "Features.coins max_count not large enough");
 
-	resp->coins_count = COINS_COUNT;
+	uint32_t defs_count;
+	const CoinInfo *defs = coinDefinitions(&defs_count);
+	resp->coins_count = 0;
+	for (uint32_t i = 0; i < defs_count; i++) {
+		fsm_fillCoinType(&resp->coins[resp->coins_count++], &defs[i]);
+	}
 	for (int i = 0; i < COINS_COUNT; i++) {
-		if (coins[i].coin_name) {
-			resp->coins[i].has_coin_name = true;
-			strlcpy(resp->coins[i].coin_name, coins[i].coin_name, sizeof(resp->coins[i].coin_name));
+		if (!coins[i].coin_name || coinByName(coins[i].coin_name) == &coins[i]) { // not replaced by a definition
+			fsm_fillCoinType(&resp->coins[resp->coins_count++], &coins[i]);
 		}
-		if (coins[i].coin_shortcut) {
-			resp->coins[i].has_coin_shortcut = true;
-			strlcpy(resp->coins[i].coin_shortcut, coins[i].coin_shortcut + 1, sizeof(resp->coins[i].coin_shortcut));
-		}
-		resp->coins[i].has_address_type = coins[i].has_address_type;
-		resp->coins[i].address_type = coins[i].address_type;
-		resp->coins[i].has_maxfee_kb = true;
-		resp->coins[i].maxfee_kb = coins[i].maxfee_kb;
-		resp->coins[i].has_address_type_p2sh = coins[i].has_address_type_p2sh;
-		resp->coins[i].address_type_p2sh = coins[i].address_type_p2sh;
-		resp->coins[i].has_xpub_magic = coins[i].xpub_magic != 0;
-		resp->coins[i].xpub_magic = coins[i].xpub_magic;
-		resp->coins[i].has_xprv_magic = coins[i].xprv_magic != 0;
-		resp->coins[i].xprv_magic = coins[i].xprv_magic;
-		resp->coins[i].has_segwit = true;
-		resp->coins[i].segwit = coins[i].has_segwit;
-		resp->coins[i].has_forkid = coins[i].has_forkid;
-		resp->coins[i].forkid = coins[i].forkid;
-		resp->coins[i].has_force_bip143 = true;
-		resp->coins[i].force_bip143 = coins[i].force_bip143;
 	}
 	resp->has_initialized = true; resp->initialized = storage_isInitialized();
 	resp->has_imported = true; resp->imported = storage_isImported();
@@ -314,6 +364,9 @@ void fsm_msgGetFeatures(GetFeatures *msg)
 	resp->has_needs_backup = true; resp->needs_backup = storage_needsBackup();
 	resp->has_flags = true; resp->flags = storage_getFlags();
 	resp->has_model = true; strlcpy(resp->model, "1", sizeof(resp->model));
+	resp->has_compressed_framing = true; resp->compressed_framing = true;
+	resp->has_witness_batch = true; resp->witness_batch = true;
+	resp->has_pre_ack_buttons = true; resp->pre_ack_buttons = true;
 
 	msg_write(MessageType_MessageType_Features, resp);
 }
@@ -399,6 +452,10 @@ void fsm_msgWipeDevice(WipeDevice *msg)
 		return;
 	}
 	storage_wipe();
+	signing_resume_clear();
+#if USE_ETHEREUM
+	ethereum_signing_abort();
+#endif
 	// the following does not work on Mac anyway :-/ Linux/Windows are fine, so it is not needed
 	// usbReconnect(); // force re-enumeration because of the serial number change
 	fsm_sendSuccess(_("Device wiped"));
@@ -500,6 +557,8 @@ void fsm_msgLoadDevice(LoadDevice *msg)
 
 void fsm_msgResetDevice(ResetDevice *msg)
 {
+	protectPreAcked = msg->has_pre_ack_buttons && msg->pre_ack_buttons;
+
 	CHECK_NOT_INITIALIZED
 
 	CHECK_PARAM(!msg->has_strength || msg->strength == 128 || msg->strength == 192 || msg->strength == 256, _("Invalid seed strength"));
@@ -528,6 +587,8 @@ void fsm_msgBackupDevice(BackupDevice *msg)
 
 void fsm_msgSignTx(SignTx *msg)
 {
+	protectPreAcked = msg->has_pre_ack_buttons && msg->pre_ack_buttons;
+
 	CHECK_INITIALIZED
 
 	CHECK_PARAM(msg->inputs_count > 0, _("Transaction must have at least one input"));
@@ -540,7 +601,13 @@ void fsm_msgSignTx(SignTx *msg)
 	const HDNode *node = fsm_getDerivedNode(coin->curve_name, NULL, 0, NULL);
 	if (!node) return;
 
-	signing_init(msg->inputs_count, msg->outputs_count, coin, node, msg->version, msg->lock_time);
+	const uint8_t *resume_token = NULL;
+	if (msg->has_resume_token) {
+		CHECK_PARAM(msg->resume_token.size == SIGNING_RESUME_TOKEN_SIZE, _("Invalid resume token"));
+		resume_token = msg->resume_token.bytes;
+	}
+
+	signing_init(msg->inputs_count, msg->outputs_count, coin, node, msg->version, msg->lock_time, resume_token);
 }
 
 void fsm_msgTxAck(TxAck *msg)
@@ -554,17 +621,30 @@ void fsm_msgCancel(Cancel *msg)
 {
 	(void)msg;
 	recovery_abort();
+	reset_abort();
 	signing_abort();
+	storage_abort();
+#if USE_ETHEREUM
 	ethereum_signing_abort();
+#endif
 	fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
 }
 
+#if USE_ETHEREUM
+
 void fsm_msgEthereumSignTx(EthereumSignTx *msg)
 {
 	CHECK_INITIALIZED
 
 	CHECK_PIN
 
+	// the next transaction of a confirmed batch is signed with the kept
+	// key; decided only here, since the batch may time out
+	if (ethereum_signing_batch_pending()) {
+		ethereum_signing_init(msg, NULL);
+		return;
+	}
+
 	const HDNode *node = fsm_getDerivedNode(SECP256K1_NAME, msg->address_n, msg->address_n_count, NULL);
 	if (!node) return;
 
@@ -575,6 +655,7 @@ void fsm_msgEthereumTxAck(EthereumTxAck *msg)
 {
 	ethereum_signing_txack(msg);
 }
+#endif
 
 void fsm_msgCipherKeyValue(CipherKeyValue *msg)
 {
@@ -628,6 +709,10 @@ void fsm_msgClearSession(ClearSession *msg)
 {
 	(void)msg;
 	session_clear(true); // clear PIN as well
+	signing_resume_clear();
+#if USE_ETHEREUM
+	ethereum_signing_abort();
+#endif
 	layoutScreensaver();
 	fsm_sendSuccess(_("Session cleared"));
 }
@@ -688,6 +773,138 @@ void fsm_msgApplySettings(ApplySettings *msg)
 	layoutHome();
 }
 
+void fsm_msgApplyPolicy(ApplyPolicy *msg)
+{
+	CHECK_INITIALIZED
+
+	CHECK_PIN
+
+	if (msg->destinations_count == 0) {
+		layoutDialogSwipe(&bmp_icon_question, _("Cancel"), _("Confirm"), NULL, _("Do you really want to"), _("remove the spending"), _("policy?"), NULL, NULL, NULL);
+		if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+			fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+			layoutHome();
+			return;
+		}
+		storage_setPolicy(NULL);
+		fsm_sendSuccess(_("Policy removed"));
+		layoutHome();
+		return;
+	}
+
+	const CoinInfo *coin = fsm_getCoin(msg->has_coin_name, msg->coin_name);
+	if (!coin) return;
+	CHECK_PARAM(policy_coinSupported(coin), _("Policy not supported for this coin"));
+
+	CHECK_PARAM(msg->has_max_amount && msg->has_total_amount && msg->max_amount <= msg->total_amount, _("Invalid amount limits"));
+	CHECK_PARAM(msg->has_max_fee_per_kb && msg->max_fee_per_kb <= coin->maxfee_kb, _("Fee limit above coin maximum"));
+
+	StoragePolicy policy;
+	memset(&policy, 0, sizeof(policy));
+	strlcpy(policy.coin_name, coin->coin_name, sizeof(policy.coin_name));
+	for (size_t i = 0; i < msg->script_types_count; i++) {
+		InputScriptType script_type = msg->script_types[i];
+		if (script_type == InputScriptType_SPENDWITNESS || script_type == InputScriptType_SPENDP2SHWITNESS) {
+			CHECK_PARAM(coin->has_segwit, _("Segwit not enabled on this coin"));
+		} else {
+			CHECK_PARAM(script_type == InputScriptType_SPENDADDRESS, _("Invalid script type"));
+		}
+		policy.script_types |= 1 << script_type;
+	}
+	CHECK_PARAM(policy.script_types != 0, _("No script type provided"));
+	for (size_t i = 0; i < msg->destinations_count; i++) {
+		const HDNodeType *node = &msg->destinations[i];
+		CHECK_PARAM(node->chain_code.size == 32 && node->has_public_key && node->public_key.size == 33, _("Invalid destination"));
+		memcpy(policy.destinations[i].chain_code, node->chain_code.bytes, 32);
+		memcpy(policy.destinations[i].public_key, node->public_key.bytes, 33);
+	}
+	policy.destinations_count = msg->destinations_count;
+	policy.max_amount = msg->max_amount;
+	policy.total_amount = msg->total_amount;
+	policy.max_fee_per_kb = msg->max_fee_per_kb;
+
+	for (size_t i = 0; i < policy.destinations_count; i++) {
+		layoutPublicKey(policy.destinations[i].public_key);
+		if (!protectButton(ButtonRequestType_ButtonRequest_PublicKey, true)) {
+			fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+			layoutHome();
+			return;
+		}
+	}
+	layoutConfirmPolicy(coin, policy.max_amount, policy.total_amount);
+	if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+		layoutHome();
+		return;
+	}
+
+	storage_setPolicy(&policy);
+	fsm_sendSuccess(_("Policy applied"));
+	layoutHome();
+}
+
+void fsm_msgLoadCoinDefinitions(LoadCoinDefinitions *msg)
+{
+	CHECK_INITIALIZED
+
+	CHECK_PIN
+
+	CHECK_PARAM(msg->has_version && msg->has_definitions, _("No definitions provided"));
+	CHECK_PARAM(msg->definitions.size % sizeof(StorageCoinDefinition) == 0
+		&& msg->definitions.size <= sizeof(((StorageCoinDefinitions *)0)->coins), _("Invalid definitions size"));
+	CHECK_PARAM(msg->signature_indexes_count == PUBKEY_SIGNATURES && msg->signatures_count == PUBKEY_SIGNATURES, _("Invalid signature count"));
+
+	const StorageCoinDefinitions *current = storage_getCoinDefinitions();
+	CHECK_PARAM(!current || msg->version > current->version, _("Definitions are not newer"));
+
+	static StorageCoinDefinitions defs;
+	memset(&defs, 0, sizeof(defs));
+	defs.version = msg->version;
+	defs.count = msg->definitions.size / sizeof(StorageCoinDefinition);
+	memcpy(defs.coins, msg->definitions.bytes, msg->definitions.size);
+	CHECK_PARAM(coinDefinitionsCheck(&defs), _("Invalid definitions"));
+
+	// digest = SHA256('TRCD' || version || count || records),
+	// version and count as 32-bit little-endian
+	uint8_t header[8];
+	uint32le(defs.version, header);
+	uint32le(defs.count, header + 4);
+	uint8_t hash[32];
+	SHA256_CTX ctx;
+	sha256_Init(&ctx);
+	sha256_Update(&ctx, (const uint8_t *)"TRCD", 4);
+	sha256_Update(&ctx, header, sizeof(header));
+	sha256_Update(&ctx, msg->definitions.bytes, msg->definitions.size);
+	sha256_Final(&ctx, hash);
+
+	const uint8_t *signatures[PUBKEY_SIGNATURES];
+	for (int i = 0; i < PUBKEY_SIGNATURES; i++) {
+		CHECK_PARAM(msg->signatures[i].size == 64, _("Invalid signature"));
+		signatures[i] = msg->signatures[i].bytes;
+	}
+	if (!pubkeys_verify(hash, msg->signature_indexes, signatures)) {
+		fsm_sendFailure(FailureType_Failure_DataError, _("Invalid signature"));
+		layoutHome();
+		return;
+	}
+
+	char count_str[12], version_str[20];
+	bn_format_uint64(defs.count, NULL, _(" coins"), 0, 0, false, count_str, sizeof(count_str));
+	bn_format_uint64(defs.version, _("version "), NULL, 0, 0, false, version_str, sizeof(version_str));
+	layoutDialogSwipe(&bmp_icon_question, _("Cancel"), _("Confirm"), NULL, _("Do you really want to"), _("install definitions"), _("for"), count_str, version_str, NULL);
+	if (!protectButton(ButtonRequestType_ButtonRequest_ProtectCall, false)) {
+		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+		layoutHome();
+		return;
+	}
+
+	storage_setCoinDefinitions(&defs);
+	storage_update();
+	coins_init();
+	fsm_sendSuccess(_("Definitions installed"));
+	layoutHome();
+}
+
 void fsm_msgApplyFlags(ApplyFlags *msg)
 {
 	if (msg->has_flags) {
@@ -828,6 +1045,8 @@ void fsm_msgGetAddress(GetAddress *msg)
 	layoutHome();
 }
 
+#if USE_ETHEREUM
+
 void fsm_msgEthereumGetAddress(EthereumGetAddress *msg)
 {
 	RESP_INIT(EthereumAddress);
@@ -910,6 +1129,7 @@ void fsm_msgEthereumVerifyMessage(EthereumVerifyMessage *msg)
 
 	layoutHome();
 }
+#endif
 
 void fsm_msgEntropyAck(EntropyAck *msg)
 {
@@ -1203,6 +1423,8 @@ void fsm_msgDecryptMessage(DecryptMessage *msg)
 
 void fsm_msgRecoveryDevice(RecoveryDevice *msg)
 {
+	protectPreAcked = msg->has_pre_ack_buttons && msg->pre_ack_buttons;
+
 	const bool dry_run = msg->has_dry_run ? msg->dry_run : false;
 	if (dry_run) {
 		CHECK_PIN
@@ -1244,6 +1466,8 @@ void fsm_msgSetU2FCounter(SetU2FCounter *msg)
 	layoutHome();
 }
 
+#if USE_NEM
+
 void fsm_msgNEMGetAddress(NEMGetAddress *msg)
 {
 	if (!msg->has_network) {
@@ -1385,10 +1609,11 @@ void fsm_msgNEMSignTx(NEMSignTx *msg) {
 	nem_transaction_start(&context, &node->public_key[1], resp->data.bytes, sizeof(resp->data.bytes));
 
 	if (msg->has_multisig) {
-		uint8_t buffer[sizeof(resp->data.bytes)];
-
 		nem_transaction_ctx inner;
-		nem_transaction_start(&inner, msg->multisig.signer.bytes, buffer, sizeof(buffer));
+		if (!nem_fsmMultisigStart(&context, &msg->transaction, msg->multisig.signer.bytes, &inner, cosigning)) {
+			layoutHome();
+			return;
+		}
 
 		if (msg->has_transfer && !nem_fsmTransfer(&inner, NULL, &msg->multisig, &msg->transfer)) {
 			layoutHome();
@@ -1420,7 +1645,7 @@ void fsm_msgNEMSignTx(NEMSignTx *msg) {
 			return;
 		}
 
-		if (!nem_fsmMultisig(&context, &msg->transaction, &inner, cosigning)) {
+		if (!nem_fsmMultisigFinish(&context, &msg->transaction, &inner, cosigning)) {
 			layoutHome();
 			return;
 		}
@@ -1531,6 +1756,7 @@ void fsm_msgNEMDecryptMessage(NEMDecryptMessage *msg)
 	msg_write(MessageType_MessageType_NEMDecryptedMessage, resp);
 	layoutHome();
 }
+#endif
 
 void fsm_msgCosiCommit(CosiCommit *msg)
 {
@@ -1663,8 +1889,104 @@ void fsm_msgDebugLinkStop(DebugLinkStop *msg)
 	(void)msg;
 }
 
+void fsm_msgDebugLinkGetTransportStats(DebugLinkGetTransportStats *msg)
+{
+	(void)msg;
+
+	DebugLinkTransportStats resp;
+	memset(&resp, 0, sizeof(resp));
+
+	resp.has_main_packets_in = true;   resp.main_packets_in = usb_stats.packets_in[USB_STATS_MAIN];
+	resp.has_main_packets_out = true;  resp.main_packets_out = usb_stats.packets_out[USB_STATS_MAIN];
+	resp.has_u2f_packets_in = true;    resp.u2f_packets_in = usb_stats.packets_in[USB_STATS_U2F];
+	resp.has_u2f_packets_out = true;   resp.u2f_packets_out = usb_stats.packets_out[USB_STATS_U2F];
+	resp.has_debug_packets_in = true;  resp.debug_packets_in = usb_stats.packets_in[USB_STATS_DEBUG];
+	resp.has_debug_packets_out = true; resp.debug_packets_out = usb_stats.packets_out[USB_STATS_DEBUG];
+	resp.has_write_spins = true;       resp.write_spins = usb_stats.write_spins;
+	resp.has_polls = true;             resp.polls = usb_stats.polls;
+	resp.has_idle_polls = true;        resp.idle_polls = usb_stats.idle_polls;
+	resp.has_tiny_ms = true;           resp.tiny_ms = usb_stats.tiny_ms;
+	resp.has_reassembly_resets = true; resp.reassembly_resets = usb_stats.reassembly_resets;
+	resp.has_out_depth_max = true;     resp.out_depth_max = usb_stats.out_depth_max;
+	resp.has_out_depth_avg = true;
+	resp.out_depth_avg = usb_stats.out_depth_samples ? usb_stats.out_depth_sum / usb_stats.out_depth_samples : 0;
+
+	msg_debug_write(MessageType_MessageType_DebugLinkTransportStats, &resp);
+}
+
+void fsm_msgDebugLinkGetSigningStats(DebugLinkGetSigningStats *msg)
+{
+	(void)msg;
+
+	DebugLinkSigningStats resp;
+	memset(&resp, 0, sizeof(resp));
+
+	_Static_assert(pb_arraysize(DebugLinkSigningStats, stage_messages) >= SIGNING_STAGE_COUNT, "DebugLinkSigningStats.stage_messages max_count not large enough");
+	for (int i = 0; i < SIGNING_STAGE_COUNT; i++) {
+		resp.stage_messages[i] = signing_stats.messages[i];
+		resp.stage_compute_ms[i] = signing_stats.compute_ms[i];
+		resp.stage_host_ms[i] = signing_stats.host_ms[i];
+	}
+	resp.stage_messages_count = SIGNING_STAGE_COUNT;
+	resp.stage_compute_ms_count = SIGNING_STAGE_COUNT;
+	resp.stage_host_ms_count = SIGNING_STAGE_COUNT;
+
+	resp.has_confirm_ms = true;  resp.confirm_ms = signing_stats.confirm_ms;
+	resp.has_sign_ms = true;     resp.sign_ms = signing_stats.sign_ms;
+	resp.has_signatures = true;  resp.signatures = signing_stats.signatures;
+	resp.has_total_ms = true;    resp.total_ms = signing_stats.total_ms;
+
+	msg_debug_write(MessageType_MessageType_DebugLinkSigningStats, &resp);
+}
+
+// sends the region as back-to-back DebugLinkMemory chunks,
+// the last one also carries the SHA-256 of the whole region
+static void fsm_debugMemoryStream(uint32_t address, uint32_t length)
+{
+	RESP_INIT(DebugLinkMemory);
+
+	// packets of 63 payload bytes needed for one chunk, with some slack
+	const uint32_t chunk_packets = (8 + sizeof(DebugLinkMemory) + 62) / 63;
+	_Static_assert((8 + sizeof(DebugLinkMemory) + 62) / 63 < MSG_DEBUG_OUT_SIZE / 64 - 1, "debug queue too small for a memory chunk");
+
+	SHA256_CTX ctx;
+	sha256_Init(&ctx);
+	usbTiny(1);
+	uint32_t offset = 0;
+	do {
+		uint32_t chunk = length - offset;
+		if (chunk > sizeof(resp->memory.bytes)) {
+			chunk = sizeof(resp->memory.bytes);
+		}
+		memset(resp, 0, sizeof(DebugLinkMemory));
+		resp->has_address = true;
+		resp->address = address + offset;
+		resp->has_memory = true;
+		memcpy(resp->memory.bytes, (void*) (address + offset), chunk);
+		resp->memory.size = chunk;
+		sha256_Update(&ctx, resp->memory.bytes, chunk);
+		offset += chunk;
+		if (offset == length) {
+			resp->has_hash = true;
+			resp->hash.size = SHA256_DIGEST_LENGTH;
+			sha256_Final(&ctx, resp->hash.bytes);
+		}
+		// let the host drain the queue instead of overwriting it
+		while (msg_debug_out_free() < chunk_packets) {
+			usbPoll();
+		}
+		msg_debug_write(MessageType_MessageType_DebugLinkMemory, resp);
+	} while (offset < length);
+	usbTiny(0);
+}
+
 void fsm_msgDebugLinkMemoryRead(DebugLinkMemoryRead *msg)
 {
+	if (msg->has_stream && msg->stream) {
+		fsm_debugMemoryStream(msg->address, msg->has_length ? msg->length : 0);
+		return;
+	}
+
 	RESP_INIT(DebugLinkMemory);
 
 	uint32_t length = 1024;
@@ -34,6 +34,8 @@ void fsm_sendFailureDebug(FailureType code, const char *text, const char *source
 void fsm_sendFailure(FailureType code, const char *text);
 #endif
 
+void fsm_abortInterruptedWorkflow(uint16_t msg_id);
+
 void fsm_msgInitialize(Initialize *msg);
 void fsm_msgGetFeatures(GetFeatures *msg);
 void fsm_msgPing(Ping *msg);
@@ -51,6 +53,8 @@ void fsm_msgTxAck(TxAck *msg);
 void fsm_msgCipherKeyValue(CipherKeyValue *msg);
 void fsm_msgClearSession(ClearSession *msg);
 void fsm_msgApplySettings(ApplySettings *msg);
+void fsm_msgApplyPolicy(ApplyPolicy *msg);
+void fsm_msgLoadCoinDefinitions(LoadCoinDefinitions *msg);
 void fsm_msgApplyFlags(ApplyFlags *msg);
 //void fsm_msgButtonAck(ButtonAck *msg);
 void fsm_msgGetAddress(GetAddress *msg);
@@ -67,15 +71,19 @@ void fsm_msgDecryptMessage(DecryptMessage *msg);
 void fsm_msgRecoveryDevice(RecoveryDevice *msg);
 void fsm_msgWordAck(WordAck *msg);
 void fsm_msgSetU2FCounter(SetU2FCounter *msg);
+#if USE_ETHEREUM
 void fsm_msgEthereumGetAddress(EthereumGetAddress *msg);
 void fsm_msgEthereumSignTx(EthereumSignTx *msg);
 void fsm_msgEthereumTxAck(EthereumTxAck *msg);
 void fsm_msgEthereumSignMessage(EthereumSignMessage *msg);
 void fsm_msgEthereumVerifyMessage(EthereumVerifyMessage *msg);
+#endif
 
+#if USE_NEM
 void fsm_msgNEMGetAddress(NEMGetAddress *msg);
 void fsm_msgNEMSignTx(NEMSignTx *msg);
 void fsm_msgNEMDecryptMessage(NEMDecryptMessage *msg);
+#endif
 
 void fsm_msgCosiCommit(CosiCommit *msg);
 void fsm_msgCosiSign(CosiSign *msg);
@@ -88,6 +96,8 @@ void fsm_msgDebugLinkStop(DebugLinkStop *msg);
 void fsm_msgDebugLinkMemoryWrite(DebugLinkMemoryWrite *msg);
 void fsm_msgDebugLinkMemoryRead(DebugLinkMemoryRead *msg);
 void fsm_msgDebugLinkFlashErase(DebugLinkFlashErase *msg);
+void fsm_msgDebugLinkGetTransportStats(DebugLinkGetTransportStats *msg);
+void fsm_msgDebugLinkGetSigningStats(DebugLinkGetSigningStats *msg);
 #endif
 
 #endif
@@ -0,0 +1,793 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2014 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libFuzzer target for the signing state machines.  It replaces trezor.o,
+ * calls the fsm handlers directly and answers every TxRequest and
+ * EthereumTxRequest itself, so no transport and no button is involved:
+ *
+ *   make -C emulator HEADLESS=1
+ *   make EMULATOR=1
+ *   make -C firmware EMULATOR=1 HEADLESS=1 AUTOCONFIRM=1 FUZZER=1 CC=clang
+ *   cd firmware && mkdir -p corpus && ./fuzzer.elf corpus
+ *
+ * The first input byte selects the target (Ethereum and NEM only in the
+ * profiles that include them), the rest drives it:
+ *
+ * Bitcoin:  a transaction of up to three inputs (legacy, P2SH-P2WPKH or
+ *           P2WPKH) and three outputs, with generated previous
+ *           transactions whose hashes match.  Unmutated, it is signed once
+ *           with the previous transactions streamed input by input and
+ *           once as raw chunks (TXRAW); outcome and serialized transaction
+ *           must be identical.  Mutated, one field of some of the TxAcks
+ *           is changed or the TxAck is decoded from the input instead.
+ * Ethereum: a transaction with up to 4 kB of data.  Unmutated, it is
+ *           signed once with the largest chunks and once with random chunk
+ *           sizes; the signatures must be identical.
+ * NEM:      NEMSignTx decoded from the input.
+ *
+ * Every handler call must answer with a message and a session must end
+ * within FUZZ_MAX_STEPS requests.  Anything else aborts, as do the
+ * sanitizers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "messages.h"
+#include "messages.pb.h"
+#include "types.pb.h"
+#include "pb_decode.h"
+#include "setup.h"
+#include "timer.h"
+#include "oled.h"
+#include "storage.h"
+#include "signing.h"
+#include "ethereum.h"
+#include "transaction.h"
+#include "sha2.h"
+
+#if !AUTOCONFIRM
+#error "the fuzzer needs AUTOCONFIRM=1"
+#endif
+
+#define H 0x80000000
+
+#define FUZZ_MNEMONIC "all all all all all all all all all all all all"
+
+#define FUZZ_MAX_STEPS        10000
+#define FUZZ_INPUTS           3
+#define FUZZ_OUTPUTS          3
+#define FUZZ_PREV_INPUTS      2
+#define FUZZ_PREV_OUTPUTS     3
+#define FUZZ_RAW_SIZE         4096
+#define FUZZ_ETHEREUM_DATA    4096
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+} FuzzInput;
+
+// outcome of one signing session
+typedef struct {
+	bool finished;
+	uint32_t failure;
+	uint8_t digest[SHA256_DIGEST_LENGTH]; // of everything serialized
+} FuzzResult;
+
+// the last message the firmware sent
+static struct {
+	uint16_t id;
+	union {
+		Failure failure;
+		TxRequest tx;
+		EthereumTxRequest ethereum;
+	} msg;
+} response;
+static bool has_response;
+
+bool __wrap_msg_write_common(char type, uint16_t msg_id, const void *msg_ptr);
+
+// linked with -Wl,--wrap=msg_write_common, see firmware/Makefile
+bool __wrap_msg_write_common(char type, uint16_t msg_id, const void *msg_ptr)
+{
+	if (type != 'n') {
+		return true;
+	}
+	response.id = msg_id;
+	switch (msg_id) {
+		case MessageType_MessageType_Failure:
+			memcpy(&response.msg.failure, msg_ptr, sizeof(Failure));
+			break;
+		case MessageType_MessageType_TxRequest:
+			memcpy(&response.msg.tx, msg_ptr, sizeof(TxRequest));
+			break;
+		case MessageType_MessageType_EthereumTxRequest:
+			memcpy(&response.msg.ethereum, msg_ptr, sizeof(EthereumTxRequest));
+			break;
+		default:
+			break;
+	}
+	has_response = true;
+	return true;
+}
+
+static uint8_t fuzz_u8(FuzzInput *in)
+{
+	return in->pos < in->size ? in->data[in->pos++] : 0;
+}
+
+static uint16_t fuzz_u16(FuzzInput *in)
+{
+	return (fuzz_u8(in) << 8) | fuzz_u8(in);
+}
+
+static uint32_t fuzz_u32(FuzzInput *in)
+{
+	return ((uint32_t)fuzz_u16(in) << 16) | fuzz_u16(in);
+}
+
+static uint64_t fuzz_u64(FuzzInput *in)
+{
+	return ((uint64_t)fuzz_u32(in) << 32) | fuzz_u32(in);
+}
+
+// a few bytes from the input, the rest pseudo-random from a seed in the
+// input, so that large fields do not need large inputs
+static void fuzz_fill(FuzzInput *in, uint8_t *out, size_t len)
+{
+	size_t i = 0;
+	for (; i < len && i < 16; i++) {
+		out[i] = fuzz_u8(in);
+	}
+	uint32_t seed = fuzz_u32(in) | 1;
+	for (; i < len; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		out[i] = seed;
+	}
+}
+
+// mutate one answer in eight
+static bool fuzz_mutation(FuzzInput *in)
+{
+	return fuzz_u8(in) >= 0xE0;
+}
+
+static bool fuzz_decode(FuzzInput *in, const pb_field_t fields[], void *msg)
+{
+	pb_istream_t stream = pb_istream_from_buffer(in->data + in->pos, in->size - in->pos);
+	bool ok = pb_decode(&stream, fields, msg);
+	in->pos = in->size - stream.bytes_left;
+	return ok;
+}
+
+static void fuzz_result_init(FuzzResult *result, SHA256_CTX *ctx)
+{
+	memset(result, 0, sizeof(FuzzResult));
+	sha256_Init(ctx);
+}
+
+// false once the session is over
+static bool fuzz_next_response(FuzzResult *result, SHA256_CTX *ctx, int steps)
+{
+	if (!has_response) {
+		fprintf(stderr, "fuzzer: handler returned without an answer\n");
+		abort();
+	}
+	has_response = false;
+	if (steps > FUZZ_MAX_STEPS) {
+		fprintf(stderr, "fuzzer: session does not end\n");
+		abort();
+	}
+	if (response.id == MessageType_MessageType_Failure) {
+		result->failure = response.msg.failure.code;
+		sha256_Final(ctx, result->digest);
+		return false;
+	}
+	return true;
+}
+
+static void fuzz_check(const FuzzResult *reference, const FuzzResult *result, const char *what)
+{
+	if (reference->finished != result->finished
+		|| reference->failure != result->failure
+		|| memcmp(reference->digest, result->digest, sizeof(result->digest)) != 0) {
+		fprintf(stderr, "fuzzer: %s differ from the reference (finished %d/%d, failure %u/%u)\n",
+			what, reference->finished, result->finished,
+			(unsigned)reference->failure, (unsigned)result->failure);
+		abort();
+	}
+}
+
+/*
+ * Bitcoin
+ */
+
+typedef struct {
+	TxInputType input;
+	// the previous transaction it spends
+	uint32_t version;
+	uint32_t lock_time;
+	uint32_t inputs_cnt;
+	uint32_t outputs_cnt;
+	TxInputType inputs[FUZZ_PREV_INPUTS];
+	TxOutputBinType outputs[FUZZ_PREV_OUTPUTS];
+	uint8_t raw[FUZZ_RAW_SIZE];
+	uint32_t raw_size;
+} FuzzInputTx;
+
+static struct {
+	uint32_t version;
+	uint32_t lock_time;
+	uint32_t inputs_count;
+	uint32_t outputs_count;
+	FuzzInputTx inputs[FUZZ_INPUTS];
+	TxOutputType outputs[FUZZ_OUTPUTS];
+} btc;
+
+static void fuzz_bitcoin_prev(FuzzInput *in, FuzzInputTx *prev)
+{
+	prev->version = 1 + (fuzz_u8(in) & 1);
+	prev->lock_time = fuzz_u32(in);
+	prev->inputs_cnt = 1 + fuzz_u8(in) % FUZZ_PREV_INPUTS;
+	prev->outputs_cnt = 1 + fuzz_u8(in) % FUZZ_PREV_OUTPUTS;
+
+	TxStruct t;
+	tx_init(&t, prev->inputs_cnt, prev->outputs_cnt, prev->version, prev->lock_time, 0, HASHER_SHA2);
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < prev->inputs_cnt; i++) {
+		TxInputType *txin = &prev->inputs[i];
+		memset(txin, 0, sizeof(TxInputType));
+		txin->prev_hash.size = 32;
+		fuzz_fill(in, txin->prev_hash.bytes, 32);
+		txin->prev_index = fuzz_u32(in);
+		txin->has_script_sig = true;
+		txin->script_sig.size = fuzz_u8(in) % 200;
+		fuzz_fill(in, txin->script_sig.bytes, txin->script_sig.size);
+		txin->has_sequence = true;
+		txin->sequence = fuzz_u32(in);
+		r += tx_serialize_input(&t, txin, prev->raw + r);
+	}
+	for (uint32_t i = 0; i < prev->outputs_cnt; i++) {
+		TxOutputBinType *txout = &prev->outputs[i];
+		memset(txout, 0, sizeof(TxOutputBinType));
+		txout->amount = fuzz_u32(in);
+		txout->script_pubkey.size = fuzz_u16(in) % (sizeof(txout->script_pubkey.bytes) + 1);
+		fuzz_fill(in, txout->script_pubkey.bytes, txout->script_pubkey.size);
+		// the last output also writes the lock time
+		r += tx_serialize_output(&t, txout, prev->raw + r);
+	}
+	prev->raw_size = r;
+}
+
+static void fuzz_bitcoin_model(FuzzInput *in)
+{
+	static const uint32_t purposes[] = { 44, 49, 84 };
+	static const InputScriptType input_types[] = {
+		InputScriptType_SPENDADDRESS,
+		InputScriptType_SPENDP2SHWITNESS,
+		InputScriptType_SPENDWITNESS,
+	};
+	static const char *addresses[] = {
+		"1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa",
+		"3J98t1WpEZ73CNmQviecrnyiWrnqRhWNLy",
+		"bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4",
+	};
+
+	btc.version = 1 + (fuzz_u8(in) & 1);
+	btc.lock_time = (fuzz_u8(in) & 1) ? fuzz_u32(in) : 0;
+	btc.inputs_count = 1 + fuzz_u8(in) % FUZZ_INPUTS;
+	btc.outputs_count = 1 + fuzz_u8(in) % FUZZ_OUTPUTS;
+
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < btc.inputs_count; i++) {
+		FuzzInputTx *prev = &btc.inputs[i];
+		fuzz_bitcoin_prev(in, prev);
+
+		uint8_t hash[32];
+		sha256_Raw(prev->raw, prev->raw_size, hash);
+		TxInputType *txin = &prev->input;
+		memset(txin, 0, sizeof(TxInputType));
+		sha256_Raw(hash, sizeof(hash), txin->prev_hash.bytes);
+		// transaction hashes are shown byte-reversed
+		for (int j = 0; j < 16; j++) {
+			uint8_t b = txin->prev_hash.bytes[j];
+			txin->prev_hash.bytes[j] = txin->prev_hash.bytes[31 - j];
+			txin->prev_hash.bytes[31 - j] = b;
+		}
+		txin->prev_hash.size = 32;
+
+		uint8_t type = fuzz_u8(in) % 3;
+		txin->address_n_count = 5;
+		txin->address_n[0] = purposes[type] | H;
+		txin->address_n[1] = 0 | H;
+		txin->address_n[2] = 0 | H;
+		txin->address_n[3] = 0;
+		txin->address_n[4] = fuzz_u8(in) % 4;
+		txin->prev_index = fuzz_u8(in) % prev->outputs_cnt;
+		txin->has_script_type = true;
+		txin->script_type = input_types[type];
+		txin->has_sequence = true;
+		txin->sequence = (fuzz_u8(in) & 1) ? 0xFFFFFFFE : 0xFFFFFFFF;
+		txin->has_amount = true;
+		txin->amount = prev->outputs[txin->prev_index].amount;
+		total += txin->amount;
+	}
+
+	for (uint32_t i = 0; i < btc.outputs_count; i++) {
+		TxOutputType *txout = &btc.outputs[i];
+		memset(txout, 0, sizeof(TxOutputType));
+		txout->script_type = OutputScriptType_PAYTOADDRESS;
+		txout->amount = total / btc.outputs_count * (fuzz_u8(in) % 101) / 100;
+		switch (fuzz_u8(in) % 3) {
+			case 0:
+				txout->has_address = true;
+				strlcpy(txout->address, addresses[fuzz_u8(in) % 3], sizeof(txout->address));
+				break;
+			case 1: // change
+				txout->address_n_count = 5;
+				txout->address_n[0] = 44 | H;
+				txout->address_n[1] = 0 | H;
+				txout->address_n[2] = 0 | H;
+				txout->address_n[3] = 1;
+				txout->address_n[4] = fuzz_u8(in) % 4;
+				break;
+			default:
+				txout->script_type = OutputScriptType_PAYTOOPRETURN;
+				txout->amount = 0;
+				txout->has_op_return_data = true;
+				txout->op_return_data.size = fuzz_u8(in) % (sizeof(txout->op_return_data.bytes) + 1);
+				fuzz_fill(in, txout->op_return_data.bytes, txout->op_return_data.size);
+				break;
+		}
+	}
+}
+
+static const FuzzInputTx *fuzz_bitcoin_prev_by_hash(const TxRequestDetailsType *details)
+{
+	for (uint32_t i = 0; i < btc.inputs_count; i++) {
+		const TxInputType *txin = &btc.inputs[i].input;
+		if (details->tx_hash.size == txin->prev_hash.size
+			&& memcmp(details->tx_hash.bytes, txin->prev_hash.bytes, txin->prev_hash.size) == 0) {
+			return &btc.inputs[i];
+		}
+	}
+	return NULL;
+}
+
+// what a well-behaved host answers
+static void fuzz_bitcoin_answer(const TxRequest *req, bool raw, TransactionType *tx)
+{
+	const TxRequestDetailsType *details = &req->details;
+	uint32_t idx = details->request_index;
+	const FuzzInputTx *prev = NULL;
+	if (details->has_tx_hash) {
+		prev = fuzz_bitcoin_prev_by_hash(details);
+		if (!prev) {
+			// only after a mutation, leave the answer empty
+			return;
+		}
+	}
+
+	switch (req->request_type) {
+		case RequestType_TXINPUT:
+			tx->inputs_count = 1;
+			if (prev && idx < prev->inputs_cnt) {
+				tx->inputs[0] = prev->inputs[idx];
+			} else if (!prev && idx < btc.inputs_count) {
+				tx->inputs[0] = btc.inputs[idx].input;
+			}
+			break;
+		case RequestType_TXOUTPUT:
+			if (prev) {
+				tx->bin_outputs_count = 1;
+				if (idx < prev->outputs_cnt) {
+					tx->bin_outputs[0] = prev->outputs[idx];
+				}
+			} else {
+				tx->outputs_count = 1;
+				if (idx < btc.outputs_count) {
+					tx->outputs[0] = btc.outputs[idx];
+				}
+			}
+			break;
+		case RequestType_TXMETA:
+			if (!prev) {
+				break;
+			}
+			tx->has_version = true;
+			tx->version = prev->version;
+			tx->has_lock_time = true;
+			tx->lock_time = prev->lock_time;
+			tx->has_inputs_cnt = true;
+			tx->inputs_cnt = prev->inputs_cnt;
+			tx->has_outputs_cnt = true;
+			tx->outputs_cnt = prev->outputs_cnt;
+			if (raw) {
+				tx->has_raw_size = true;
+				tx->raw_size = prev->raw_size;
+			}
+			break;
+		case RequestType_TXRAW:
+			if (!prev
+				|| details->extra_data_offset > prev->raw_size
+				|| details->extra_data_len > prev->raw_size - details->extra_data_offset
+				|| details->extra_data_len > sizeof(tx->extra_data.bytes)) {
+				break;
+			}
+			tx->has_extra_data = true;
+			tx->extra_data.size = details->extra_data_len;
+			memcpy(tx->extra_data.bytes, prev->raw + details->extra_data_offset, details->extra_data_len);
+			break;
+		default:
+			// the model has no extra data
+			break;
+	}
+}
+
+// what a broken or malicious host answers
+static void fuzz_bitcoin_mutate(FuzzInput *in, TxAck *ack)
+{
+	TransactionType *tx = &ack->tx;
+	switch (fuzz_u8(in) % 12) {
+		case 0:
+			tx->inputs[0].has_amount = true;
+			tx->inputs[0].amount = fuzz_u64(in);
+			break;
+		case 1:
+			tx->inputs[0].prev_index = fuzz_u32(in);
+			break;
+		case 2:
+			tx->inputs[0].script_type = fuzz_u8(in) % 6;
+			break;
+		case 3:
+			tx->inputs[0].address_n_count = fuzz_u8(in) % 9;
+			tx->inputs[0].address_n[fuzz_u8(in) % 8] = fuzz_u32(in);
+			break;
+		case 4:
+			tx->bin_outputs[0].amount = fuzz_u64(in);
+			break;
+		case 5:
+			tx->outputs[0].amount = fuzz_u64(in);
+			break;
+		case 6:
+			tx->outputs[0].script_type = fuzz_u8(in) % 6;
+			break;
+		case 7:
+			tx->inputs_cnt = fuzz_u32(in);
+			tx->outputs_cnt = fuzz_u32(in);
+			break;
+		case 8:
+			tx->has_raw_size = fuzz_u8(in) & 1;
+			tx->raw_size = fuzz_u32(in);
+			break;
+		case 9:
+			tx->extra_data.size = fuzz_u16(in) % (sizeof(tx->extra_data.bytes) + 1);
+			break;
+		case 10:
+			tx->extra_data.bytes[fuzz_u16(in) % sizeof(tx->extra_data.bytes)] ^= fuzz_u8(in) | 1;
+			tx->bin_outputs[0].script_pubkey.bytes[fuzz_u16(in) % sizeof(tx->bin_outputs[0].script_pubkey.bytes)] ^= fuzz_u8(in) | 1;
+			break;
+		default:
+			memset(ack, 0, sizeof(TxAck));
+			fuzz_decode(in, TxAck_fields, ack);
+			break;
+	}
+}
+
+static void fuzz_bitcoin_session(FuzzInput *in, bool raw, bool mutate, FuzzResult *result)
+{
+	static SignTx msg;
+	static TxAck ack;
+	SHA256_CTX ctx;
+
+	fuzz_result_init(result, &ctx);
+	signing_abort();
+
+	memset(&msg, 0, sizeof(msg));
+	msg.inputs_count = btc.inputs_count;
+	msg.outputs_count = btc.outputs_count;
+	msg.has_coin_name = true;
+	strlcpy(msg.coin_name, "Bitcoin", sizeof(msg.coin_name));
+	msg.has_version = true;
+	msg.version = btc.version;
+	msg.has_lock_time = true;
+	msg.lock_time = btc.lock_time;
+	fsm_msgSignTx(&msg);
+
+	for (int steps = 0; fuzz_next_response(result, &ctx, steps); steps++) {
+		if (response.id != MessageType_MessageType_TxRequest) {
+			fprintf(stderr, "fuzzer: unexpected message %d\n", response.id);
+			abort();
+		}
+		const TxRequest *req = &response.msg.tx;
+		if (req->has_serialized) {
+			const TxRequestSerializedType *s = &req->serialized;
+			if (s->has_signature_index) {
+				sha256_Update(&ctx, (const uint8_t *)&s->signature_index, sizeof(s->signature_index));
+			}
+			if (s->has_signature) {
+				sha256_Update(&ctx, s->signature.bytes, s->signature.size);
+			}
+			if (s->has_serialized_tx) {
+				sha256_Update(&ctx, s->serialized_tx.bytes, s->serialized_tx.size);
+			}
+		}
+		if (req->request_type == RequestType_TXFINISHED) {
+			result->finished = true;
+			sha256_Final(&ctx, result->digest);
+			break;
+		}
+
+		memset(&ack, 0, sizeof(ack));
+		ack.has_tx = true;
+		fuzz_bitcoin_answer(req, raw, &ack.tx);
+		if (mutate && fuzz_mutation(in)) {
+			fuzz_bitcoin_mutate(in, &ack);
+		}
+		fsm_msgTxAck(&ack);
+	}
+	signing_abort();
+}
+
+static void fuzz_bitcoin(FuzzInput *in)
+{
+	FuzzResult reference, result;
+	fuzz_bitcoin_model(in);
+	if (fuzz_u8(in) & 1) {
+		fuzz_bitcoin_session(in, fuzz_u8(in) & 1, true, &result);
+		return;
+	}
+	fuzz_bitcoin_session(in, false, false, &reference);
+	fuzz_bitcoin_session(in, true, false, &result);
+	fuzz_check(&reference, &result, "raw previous transactions");
+}
+
+#if USE_ETHEREUM
+
+/*
+ * Ethereum
+ */
+
+static struct {
+	EthereumSignTx msg;
+	uint8_t data[FUZZ_ETHEREUM_DATA];
+	uint32_t data_length;
+} eth;
+
+static void fuzz_ethereum_model(FuzzInput *in)
+{
+	EthereumSignTx *msg = &eth.msg;
+	memset(msg, 0, sizeof(EthereumSignTx));
+	msg->address_n_count = 5;
+	msg->address_n[0] = 44 | H;
+	msg->address_n[1] = 60 | H;
+	msg->address_n[2] = 0 | H;
+	msg->address_n[3] = 0;
+	msg->address_n[4] = fuzz_u8(in) % 4;
+	msg->has_nonce = true;
+	msg->nonce.size = fuzz_u8(in) % 9;
+	fuzz_fill(in, msg->nonce.bytes, msg->nonce.size);
+	msg->has_gas_price = true;
+	msg->gas_price.size = 1 + fuzz_u8(in) % 8;
+	fuzz_fill(in, msg->gas_price.bytes, msg->gas_price.size);
+	msg->has_gas_limit = true;
+	msg->gas_limit.size = 1 + fuzz_u8(in) % 4;
+	fuzz_fill(in, msg->gas_limit.bytes, msg->gas_limit.size);
+	msg->has_value = true;
+	msg->value.size = fuzz_u8(in) % 33;
+	fuzz_fill(in, msg->value.bytes, msg->value.size);
+	if (fuzz_u8(in) % 8) {
+		msg->has_to = true;
+		msg->to.size = 20;
+		fuzz_fill(in, msg->to.bytes, 20);
+	}
+	if (fuzz_u8(in) & 1) {
+		msg->has_chain_id = true;
+		msg->chain_id = 1 + fuzz_u8(in);
+	}
+	eth.data_length = fuzz_u16(in) % (FUZZ_ETHEREUM_DATA + 1);
+	fuzz_fill(in, eth.data, eth.data_length);
+	if (eth.data_length > 0) {
+		msg->has_data_length = true;
+		msg->data_length = eth.data_length;
+		msg->has_data_initial_chunk = true;
+	}
+}
+
+static void fuzz_ethereum_mutate(FuzzInput *in, EthereumSignTx *msg)
+{
+	switch (fuzz_u8(in) % 6) {
+		case 0:
+			msg->has_data_length = fuzz_u8(in) & 1;
+			msg->data_length = fuzz_u32(in);
+			break;
+		case 1:
+			msg->data_initial_chunk.size = fuzz_u16(in) % (sizeof(msg->data_initial_chunk.bytes) + 1);
+			break;
+		case 2:
+			msg->to.size = fuzz_u8(in) % 21;
+			break;
+		case 3:
+			msg->has_chain_id = true;
+			msg->chain_id = fuzz_u32(in);
+			break;
+		case 4:
+			msg->gas_price.size = fuzz_u8(in) % (sizeof(msg->gas_price.bytes) + 1);
+			msg->gas_limit.size = fuzz_u8(in) % (sizeof(msg->gas_limit.bytes) + 1);
+			break;
+		default:
+			memset(msg, 0, sizeof(EthereumSignTx));
+			fuzz_decode(in, EthereumSignTx_fields, msg);
+			break;
+	}
+}
+
+static void fuzz_ethereum_session(FuzzInput *in, bool chunked, bool mutate, FuzzResult *result)
+{
+	static EthereumSignTx msg;
+	static EthereumTxAck ack;
+	SHA256_CTX ctx;
+
+	fuzz_result_init(result, &ctx);
+	ethereum_signing_abort();
+
+	// the firmware changes the message
+	memcpy(&msg, &eth.msg, sizeof(msg));
+	uint32_t sent = eth.data_length < sizeof(msg.data_initial_chunk.bytes)
+		? eth.data_length : sizeof(msg.data_initial_chunk.bytes);
+	if (chunked && sent > 1) {
+		sent = 1 + fuzz_u16(in) % sent;
+	}
+	msg.data_initial_chunk.size = sent;
+	memcpy(msg.data_initial_chunk.bytes, eth.data, sent);
+	if (mutate && fuzz_mutation(in)) {
+		fuzz_ethereum_mutate(in, &msg);
+	}
+	fsm_msgEthereumSignTx(&msg);
+
+	for (int steps = 0; fuzz_next_response(result, &ctx, steps); steps++) {
+		if (response.id != MessageType_MessageType_EthereumTxRequest) {
+			fprintf(stderr, "fuzzer: unexpected message %d\n", response.id);
+			abort();
+		}
+		const EthereumTxRequest *req = &response.msg.ethereum;
+		if (!req->has_data_length) {
+			sha256_Update(&ctx, (const uint8_t *)&req->signature_v, sizeof(req->signature_v));
+			sha256_Update(&ctx, req->signature_r.bytes, req->signature_r.size);
+			sha256_Update(&ctx, req->signature_s.bytes, req->signature_s.size);
+			result->finished = true;
+			sha256_Final(&ctx, result->digest);
+			break;
+		}
+
+		uint32_t len = req->data_length;
+		if (chunked && len > 1) {
+			len = 1 + fuzz_u16(in) % len;
+		}
+		if (sent > eth.data_length) {
+			sent = eth.data_length;
+		}
+		if (len > eth.data_length - sent) {
+			// only after a mutation
+			len = eth.data_length - sent;
+		}
+		if (len > sizeof(ack.data_chunk.bytes)) {
+			len = sizeof(ack.data_chunk.bytes);
+		}
+		memset(&ack, 0, sizeof(ack));
+		ack.has_data_chunk = true;
+		ack.data_chunk.size = len;
+		memcpy(ack.data_chunk.bytes, eth.data + sent, len);
+		sent += len;
+		if (mutate && fuzz_mutation(in)) {
+			ack.has_data_chunk = fuzz_u8(in) & 1;
+			ack.data_chunk.size = fuzz_u16(in) % (sizeof(ack.data_chunk.bytes) + 1);
+		}
+		fsm_msgEthereumTxAck(&ack);
+	}
+	ethereum_signing_abort();
+}
+
+static void fuzz_ethereum(FuzzInput *in)
+{
+	FuzzResult reference, result;
+	fuzz_ethereum_model(in);
+	if (fuzz_u8(in) & 1) {
+		fuzz_ethereum_session(in, fuzz_u8(in) & 1, true, &result);
+		return;
+	}
+	fuzz_ethereum_session(in, false, false, &reference);
+	fuzz_ethereum_session(in, true, false, &result);
+	fuzz_check(&reference, &result, "chunked signatures");
+}
+
+#endif
+
+#if USE_NEM
+
+/*
+ * NEM
+ */
+
+static void fuzz_nem(FuzzInput *in)
+{
+	static NEMSignTx msg;
+	memset(&msg, 0, sizeof(msg));
+	if (!fuzz_decode(in, NEMSignTx_fields, &msg)) {
+		return;
+	}
+	has_response = false;
+	fsm_msgNEMSignTx(&msg);
+	if (!has_response) {
+		fprintf(stderr, "fuzzer: handler returned without an answer\n");
+		abort();
+	}
+}
+
+#endif
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	(void)argc;
+	(void)argv;
+
+	setup();
+	oledInit();
+	timer_init();
+	storage_init();
+	storage_wipe();
+
+	static LoadDevice load;
+	memset(&load, 0, sizeof(load));
+	load.has_mnemonic = true;
+	strlcpy(load.mnemonic, FUZZ_MNEMONIC, sizeof(load.mnemonic));
+	storage_loadDevice(&load);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	FuzzInput in = { data, size, 0 };
+	has_response = false;
+	switch (fuzz_u8(&in) % 3) {
+#if USE_ETHEREUM
+		case 1:
+			fuzz_ethereum(&in);
+			break;
+#endif
+#if USE_NEM
+		case 2:
+			fuzz_nem(&in);
+			break;
+#endif
+		default:
+			fuzz_bitcoin(&in);
+			break;
+	}
+	return 0;
+}
@@ -31,7 +31,9 @@
 #include "timer.h"
 #include "bignum.h"
 #include "secp256k1.h"
+#if USE_NEM
 #include "nem2.h"
+#endif
 #include "gettext.h"
 
 #define BITCOIN_DIVISIBILITY (8)
@@ -215,13 +217,16 @@ void layoutHome(void)
 	}
 	layoutLast = layoutHome;
 	const char *label = storage_isInitialized() ? storage_getLabel() : _("Go to trezor.io/start");
-	const uint8_t *homescreen = storage_getHomescreen();
-	if (homescreen) {
+	uint32_t homescreen_size;
+	const uint8_t *homescreen = storage_getHomescreen(&homescreen_size);
+	if (homescreen && homescreen_size == 1024) {
 		BITMAP b;
 		b.width = 128;
 		b.height = 64;
 		b.data = homescreen;
 		oledDrawBitmap(0, 0, &b);
+	} else if (homescreen) {
+		oledDrawPacked(homescreen, homescreen_size);
 	} else {
 		if (label && strlen(label) > 0) {
 			oledDrawBitmap(44, 4, &bmp_logo48);
@@ -240,12 +245,11 @@ void layoutHome(void)
 	system_millis_lock_start = timer_ms();
 }
 
-void layoutConfirmOutput(const CoinInfo *coin, const TxOutputType *out)
+static void layoutConfirmSending(const CoinInfo *coin, uint64_t amount, const char *addr, const uint32_t *address_n, size_t address_n_count)
 {
 	char str_out[32 + 3];
-	bn_format_uint64(out->amount, NULL, coin->coin_shortcut, BITCOIN_DIVISIBILITY, 0, false, str_out, sizeof(str_out) - 3);
+	bn_format_uint64(amount, NULL, coin->coin_shortcut, BITCOIN_DIVISIBILITY, 0, false, str_out, sizeof(str_out) - 3);
 	strlcat(str_out, " to", sizeof(str_out));
-	const char *addr = out->address;
 	int addrlen = strlen(addr);
 	int numlines = addrlen <= 42 ? 2 : 3;
 	int linelen = (addrlen - 1) / numlines + 1;
@@ -265,8 +269,8 @@ void layoutConfirmOutput(const CoinInfo *coin, const TxOutputType *out)
 	oledDrawString(left, 4 * 9, str[2], FONT_FIXED);
 	oledDrawString(left, 5 * 9, str[3], FONT_FIXED);
 	if (!str[3][0]) {
-		if (out->address_n_count > 0) {
-			oledDrawString(0, 5*9, address_n_str(out->address_n, out->address_n_count), FONT_STANDARD);
+		if (address_n_count > 0) {
+			oledDrawString(0, 5*9, address_n_str(address_n, address_n_count), FONT_STANDARD);
 		} else {
 			oledHLine(OLED_HEIGHT - 13);
 		}
@@ -276,6 +280,16 @@ void layoutConfirmOutput(const CoinInfo *coin, const TxOutputType *out)
 	oledRefresh();
 }
 
+void layoutConfirmOutput(const CoinInfo *coin, const TxOutputType *out)
+{
+	layoutConfirmSending(coin, out->amount, out->address, out->address_n, out->address_n_count);
+}
+
+void layoutConfirmOutputAddress(const CoinInfo *coin, uint64_t amount, const char *address)
+{
+	layoutConfirmSending(coin, amount, address, NULL, 0);
+}
+
 void layoutConfirmOpReturn(const uint8_t *data, uint32_t size)
 {
 	bool ascii_only = true;
@@ -342,6 +356,24 @@ void layoutFeeOverThreshold(const CoinInfo *coin, uint64_t fee)
 	);
 }
 
+void layoutConfirmPolicy(const CoinInfo *coin, uint64_t max_amount, uint64_t total_amount)
+{
+	char str_max[32], str_total[32];
+	bn_format_uint64(max_amount, NULL, coin->coin_shortcut, BITCOIN_DIVISIBILITY, 0, false, str_max, sizeof(str_max));
+	bn_format_uint64(total_amount, NULL, coin->coin_shortcut, BITCOIN_DIVISIBILITY, 0, false, str_total, sizeof(str_total));
+	layoutDialogSwipe(&bmp_icon_question,
+		_("Cancel"),
+		_("Confirm"),
+		NULL,
+		_("Sign without asking"),
+		_("up to"),
+		str_max,
+		_("per transaction and"),
+		str_total,
+		_("in total?")
+	);
+}
+
 void layoutSignMessage(const uint8_t *msg, uint32_t len)
 {
 	const char **str = split_message(msg, len, 16);
@@ -639,6 +671,8 @@ void layoutU2FDialog(const char *verb, const char *appname, const BITMAP *appico
 	layoutDialog(appicon, NULL, verb, NULL, verb, _("U2F security key?"), NULL, appname, NULL, NULL);
 }
 
+#if USE_NEM
+
 void layoutNEMDialog(const BITMAP *icon, const char *btnNo, const char *btnYes, const char *desc, const char *line1, const char *address) {
 	static char first_third[NEM_ADDRESS_SIZE / 3 + 1];
 	strlcpy(first_third, address, sizeof(first_third));
@@ -815,6 +849,7 @@ void layoutNEMLevy(const NEMMosaicDefinition *definition, uint8_t network) {
 		break;
 	}
 }
+#endif
 
 static inline bool is_slip18(const uint32_t *address_n, size_t address_n_count)
 {
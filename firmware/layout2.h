@@ -41,9 +41,11 @@ void layoutProgressSwipe(const char *desc, int permil);
 void layoutScreensaver(void);
 void layoutHome(void);
 void layoutConfirmOutput(const CoinInfo *coin, const TxOutputType *out);
+void layoutConfirmOutputAddress(const CoinInfo *coin, uint64_t amount, const char *address);
 void layoutConfirmOpReturn(const uint8_t *data, uint32_t size);
 void layoutConfirmTx(const CoinInfo *coin, uint64_t amount_out, uint64_t amount_fee);
 void layoutFeeOverThreshold(const CoinInfo *coin, uint64_t fee);
+void layoutConfirmPolicy(const CoinInfo *coin, uint64_t max_amount, uint64_t total_amount);
 void layoutSignMessage(const uint8_t *msg, uint32_t len);
 void layoutVerifyAddress(const char *address);
 void layoutVerifyMessage(const uint8_t *msg, uint32_t len);
@@ -57,6 +59,7 @@ void layoutSignIdentity(const IdentityType *identity, const char *challenge);
 void layoutDecryptIdentity(const IdentityType *identity);
 void layoutU2FDialog(const char *verb, const char *appname, const BITMAP *appicon);
 
+#if USE_NEM
 void layoutNEMDialog(const BITMAP *icon, const char *btnNo, const char *btnYes, const char *desc, const char *line1, const char *address);
 void layoutNEMTransferXEM(const char *desc, uint64_t quantity, const bignum256 *multiplier, uint64_t fee);
 void layoutNEMNetworkFee(const char *desc, bool confirm, const char *fee1_desc, uint64_t fee1, const char *fee2_desc, uint64_t fee2);
@@ -65,6 +68,7 @@ void layoutNEMTransferUnknownMosaic(const char *namespace, const char *mosaic, u
 void layoutNEMTransferPayload(const uint8_t *payload, size_t length, bool encrypted);
 void layoutNEMMosaicDescription(const char *description);
 void layoutNEMLevy(const NEMMosaicDefinition *definition, uint8_t network);
+#endif
 
 void layoutCosiCommitSign(const uint32_t *address_n, size_t address_n_count, const uint8_t *data, uint32_t len, bool final_sign);
 
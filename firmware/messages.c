@@ -25,6 +25,11 @@
 #include "fsm.h"
 #include "util.h"
 #include "gettext.h"
+#include "usb.h"
+#include "protect.h"
+#if USE_ETHEREUM
+#include "ethereum.h"
+#endif
 
 #include "pb_decode.h"
 #include "pb_encode.h"
@@ -230,70 +235,362 @@ enum {
 	READSTATE_READING,
 };
 
-void msg_process(char type, uint16_t msg_id, const pb_field_t *fields, uint8_t *msg_raw, uint32_t msg_size)
+bool msg_process(char type, uint16_t msg_id, const pb_field_t *fields, uint8_t *msg_raw, uint32_t msg_size)
 {
 	static CONFIDENTIAL uint8_t msg_data[MSG_IN_SIZE];
 	memset(msg_data, 0, sizeof(msg_data));
 	pb_istream_t stream = pb_istream_from_buffer(msg_raw, msg_size);
 	bool status = pb_decode(&stream, fields, msg_data);
 	if (status) {
+		if (type == 'n') {
+			protectPreAckUpdate(msg_id);
+			fsm_abortInterruptedWorkflow(msg_id);
+		}
 		MessageProcessFunc(type, 'i', msg_id, msg_data);
 	} else {
 		fsm_sendFailure(FailureType_Failure_DataError, stream.errmsg);
 	}
+	return status;
 }
 
-void msg_read_common(char type, const uint8_t *buf, int len)
+/*
+ * Messages that are not handled in tiny mode are not rejected while a
+ * workflow blocks (button, PIN, PBKDF2), but are queued and dispatched
+ * in order from the main loop once the workflow is finished.
+ * Entries are stored as: type (1), msg_id (2), msg_size (4), payload.
+ */
+#define MSG_QUEUE_HEADER 7
+
+static CONFIDENTIAL uint8_t msg_queue[MSG_QUEUE_SIZE];
+static uint32_t msg_queue_start = 0;
+static uint32_t msg_queue_end = 0;
+
+static bool msg_queue_empty(void)
+{
+	return msg_queue_start == msg_queue_end;
+}
+
+static bool msg_queue_push(char type, uint16_t msg_id, const uint8_t *msg_raw, uint32_t msg_size)
+{
+	if (msg_size > MSG_QUEUE_SIZE - MSG_QUEUE_HEADER) {
+		return false;
+	}
+	if (msg_queue_end + MSG_QUEUE_HEADER + msg_size > MSG_QUEUE_SIZE) {
+		// move pending entries to the front to make room
+		memmove(msg_queue, msg_queue + msg_queue_start, msg_queue_end - msg_queue_start);
+		msg_queue_end -= msg_queue_start;
+		msg_queue_start = 0;
+		if (msg_queue_end + MSG_QUEUE_HEADER + msg_size > MSG_QUEUE_SIZE) {
+			return false;
+		}
+	}
+	uint8_t *e = msg_queue + msg_queue_end;
+	e[0] = type;
+	e[1] = (msg_id >> 8) & 0xFF;
+	e[2] = msg_id & 0xFF;
+	e[3] = (msg_size >> 24) & 0xFF;
+	e[4] = (msg_size >> 16) & 0xFF;
+	e[5] = (msg_size >> 8) & 0xFF;
+	e[6] = msg_size & 0xFF;
+	memcpy(e + MSG_QUEUE_HEADER, msg_raw, msg_size);
+	msg_queue_end += MSG_QUEUE_HEADER + msg_size;
+	return true;
+}
+
+void msg_queue_clear(void)
+{
+	memset(msg_queue, 0, sizeof(msg_queue));
+	msg_queue_start = 0;
+	msg_queue_end = 0;
+}
+
+void msg_queue_dispatch(void)
+{
+	if (msg_queue_empty()) return;
+	uint8_t *e = msg_queue + msg_queue_start;
+	char type = e[0];
+	uint16_t msg_id = (e[1] << 8) + e[2];
+	uint32_t msg_size = (e[3] << 24) + (e[4] << 16) + (e[5] << 8) + e[6];
+	// pop before processing; pushes only append or compact the pending
+	// entries, and the payload is decoded before the handler runs
+	msg_queue_start += MSG_QUEUE_HEADER + msg_size;
+	const pb_field_t *fields = MessageFields(type, 'i', msg_id);
+	if (fields) {
+		msg_process(type, msg_id, fields, e + MSG_QUEUE_HEADER, msg_size);
+	}
+	if (msg_queue_empty()) {
+		msg_queue_clear();
+	}
+}
+
+/*
+ * Compressed framing: a message starting with "?#%" instead of "?##" carries
+ * the same header (msg_id, size of the decoded message), followed by a
+ * stream of tokens which is inflated directly into msg_in:
+ *   0x00 - 0x7F  literal run of (t + 1) bytes following the token
+ *   0x80 - 0xBF  copy of ((t & 0x3F) + 3) bytes from distance d in the
+ *                output, d is given by the next two bytes (big endian)
+ *   0xC0 - 0xFF  entry (t & 0x3F) of the static dictionary below
+ * The dictionary is part of the wire format, only append to it.
+ */
+static const struct {
+	uint8_t size;
+	const char *bytes;	// NULL means zeros
+} msg_dict[] = {
+	{  4, NULL },                           // zeros
+	{  8, NULL },
+	{ 32, NULL },
+	{  4, "\xff\xff\xff\xff" },             // sequence
+	{  4, "\xfe\xff\xff\xff" },
+	{  4, "\xfd\xff\xff\xff" },
+	{  3, "\x76\xa9\x14" },                 // p2pkh script
+	{  2, "\x88\xac" },
+	{  2, "\xa9\x14" },                     // p2sh script
+	{  2, "\x00\x14" },                     // p2wpkh script
+	{  2, "\x00\x20" },                     // p2wsh script
+	{  5, "\x47\x30\x44\x02\x20" },         // DER signature push
+	{  6, "\x48\x30\x45\x02\x21\x00" },
+	{  2, "\x01\x21" },                     // sighash, pubkey push
+	{  5, "\xac\x80\x80\x80\x08" },         // address_n 44'
+	{  5, "\xb1\x80\x80\x80\x08" },         // address_n 49'
+	{  5, "\xd4\x80\x80\x80\x08" },         // address_n 84'
+	{  5, "\x80\x80\x80\x80\x08" },         // address_n 0'
+};
+
+enum {
+	INFLATE_TOKEN,
+	INFLATE_LITERAL,
+	INFLATE_DIST_HI,
+	INFLATE_DIST_LO,
+};
+
+/* reassembly state of one interface, the main and debug link
+ * interleave their packets and must not share it */
+typedef struct {
+	char read_state;
+	uint16_t msg_id;
+	uint32_t msg_size;
+	uint32_t msg_pos;
+	const pb_field_t *fields;
+	bool compressed;
+	char inflate_state;
+	uint32_t inflate_count;
+	uint32_t inflate_dist;
+#if USE_ETHEREUM
+	bool stream;
+	uint32_t stream_pos;
+#endif
+	uint8_t *msg_in;
+	uint32_t msg_in_size;
+} MsgReader;
+
+static CONFIDENTIAL uint8_t msg_in[MSG_IN_SIZE];
+static MsgReader msg_reader = { .read_state = READSTATE_IDLE, .msg_in = msg_in, .msg_in_size = sizeof(msg_in) };
+
+#if DEBUG_LINK
+static CONFIDENTIAL uint8_t msg_debug_in[MSG_DEBUG_IN_SIZE];
+static MsgReader msg_debug_reader = { .read_state = READSTATE_IDLE, .msg_in = msg_debug_in, .msg_in_size = sizeof(msg_debug_in) };
+#endif
+
+static MsgReader *msg_reader_get(char type)
 {
-	static char read_state = READSTATE_IDLE;
-	static CONFIDENTIAL uint8_t msg_in[MSG_IN_SIZE];
-	static uint16_t msg_id = 0xFFFF;
-	static uint32_t msg_size = 0;
-	static uint32_t msg_pos = 0;
-	static const pb_field_t *fields = 0;
+#if DEBUG_LINK
+	if (type == 'd') {
+		return &msg_debug_reader;
+	}
+#else
+	(void)type;
+#endif
+	return &msg_reader;
+}
+
+static bool msg_inflate(MsgReader *r, const uint8_t *in, uint32_t len)
+{
+	uint8_t *out = r->msg_in;
+	uint32_t size = r->msg_size;
+	for (uint32_t i = 0; i < len && r->msg_pos < size; i++) {
+		uint8_t c = in[i];
+		switch (r->inflate_state) {
+			case INFLATE_TOKEN:
+				if (c < 0x80) {
+					r->inflate_count = c + 1;
+					r->inflate_state = INFLATE_LITERAL;
+				} else
+				if (c < 0xC0) {
+					r->inflate_count = (c & 0x3F) + 3;
+					r->inflate_state = INFLATE_DIST_HI;
+				} else {
+					c &= 0x3F;
+					if (c >= sizeof(msg_dict) / sizeof(msg_dict[0]) || msg_dict[c].size > size - r->msg_pos) {
+						return false;
+					}
+					if (msg_dict[c].bytes) {
+						memcpy(out + r->msg_pos, msg_dict[c].bytes, msg_dict[c].size);
+					} else {
+						memset(out + r->msg_pos, 0, msg_dict[c].size);
+					}
+					r->msg_pos += msg_dict[c].size;
+				}
+				break;
+			case INFLATE_LITERAL:
+				out[r->msg_pos++] = c;
+				if (--r->inflate_count == 0) {
+					r->inflate_state = INFLATE_TOKEN;
+				}
+				break;
+			case INFLATE_DIST_HI:
+				r->inflate_dist = c << 8;
+				r->inflate_state = INFLATE_DIST_LO;
+				break;
+			case INFLATE_DIST_LO:
+				r->inflate_dist |= c;
+				if (r->inflate_dist == 0 || r->inflate_dist > r->msg_pos || r->inflate_count > size - r->msg_pos) {
+					return false;
+				}
+				// byte by byte, the copy may overlap its own output
+				for (uint32_t j = 0; j < r->inflate_count; j++) {
+					out[r->msg_pos] = out[r->msg_pos - r->inflate_dist];
+					r->msg_pos++;
+				}
+				r->inflate_state = INFLATE_TOKEN;
+				break;
+		}
+	}
+	return true;
+}
+
+// the data chunk of a streamed EthereumTxAck that is dropped may already
+// be hashed in part, so the signing cannot continue
+static void msg_stream_abort(MsgReader *r)
+{
+#if USE_ETHEREUM
+	if (r->stream) {
+		r->stream = false;
+		ethereum_signing_abort();
+	}
+#else
+	(void)r;
+#endif
+}
+
+static void msg_read_packet(char type, const uint8_t *buf, int len, bool tiny)
+{
+	MsgReader *r = msg_reader_get(type);
 
 	if (len != 64) return;
 
-	if (read_state == READSTATE_IDLE) {
-		if (buf[0] != '?' || buf[1] != '#' || buf[2] != '#') {	// invalid start - discard
+	if (r->read_state == READSTATE_IDLE) {
+		if (buf[0] != '?' || buf[1] != '#' || (buf[2] != '#' && buf[2] != '%')) {	// invalid start - discard
 			return;
 		}
-		msg_id = (buf[3] << 8) + buf[4];
-		msg_size = (buf[5] << 24)+ (buf[6] << 16) + (buf[7] << 8) + buf[8];
+		r->compressed = (buf[2] == '%');
+		r->msg_id = (buf[3] << 8) + buf[4];
+		r->msg_size = (buf[5] << 24)+ (buf[6] << 16) + (buf[7] << 8) + buf[8];
 
-		fields = MessageFields(type, 'i', msg_id);
-		if (!fields) { // unknown message
+		r->fields = MessageFields(type, 'i', r->msg_id);
+		if (!r->fields) { // unknown message
 			fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("Unknown message"));
 			return;
 		}
-		if (msg_size > MSG_IN_SIZE) { // message is too big :(
+		if (r->msg_size > r->msg_in_size) { // message is too big :(
 			fsm_sendFailure(FailureType_Failure_DataError, _("Message too big"));
 			return;
 		}
 
-		read_state = READSTATE_READING;
+		r->read_state = READSTATE_READING;
 
-		memcpy(msg_in, buf + 9, len - 9);
-		msg_pos = len - 9;
+#if USE_ETHEREUM
+		// hash the data chunk while the rest of the message is received,
+		// but only for a message that is processed as soon as it is read
+		r->stream = (type == 'n' && r->msg_id == MessageType_MessageType_EthereumTxAck && !tiny && msg_queue_empty());
+		r->stream_pos = 0;
+		if (r->stream) {
+			ethereum_signing_stream_begin();
+		}
+#endif
+
+		if (r->compressed) {
+			r->msg_pos = 0;
+			r->inflate_state = INFLATE_TOKEN;
+		} else {
+			memcpy(r->msg_in, buf + 9, len - 9);
+			r->msg_pos = len - 9;
+		}
+		buf += 9;
+		len -= 9;
 	} else
-	if (read_state == READSTATE_READING) {
+	if (r->read_state == READSTATE_READING) {
 		if (buf[0] != '?') {	// invalid contents
-			read_state = READSTATE_IDLE;
+			r->read_state = READSTATE_IDLE;
+			usb_stats.reassembly_resets++;
+			msg_stream_abort(r);
 			return;
 		}
-		memcpy(msg_in + msg_pos, buf + 1, len - 1);
-		msg_pos += len - 1;
+		if (!r->compressed) {
+			// the last packet is padded, do not spill past the buffer
+			uint32_t n = len - 1;
+			if (n > r->msg_in_size - r->msg_pos) {
+				n = r->msg_in_size - r->msg_pos;
+			}
+			memcpy(r->msg_in + r->msg_pos, buf + 1, n);
+			r->msg_pos += n;
+		}
+		buf += 1;
+		len -= 1;
+	}
+
+	if (r->compressed && !msg_inflate(r, buf, len)) {
+		fsm_sendFailure(FailureType_Failure_DataError, _("Invalid compressed data"));
+		r->msg_pos = 0;
+		r->read_state = READSTATE_IDLE;
+		msg_stream_abort(r);
+		return;
 	}
 
-	if (msg_pos >= msg_size) {
-		msg_process(type, msg_id, fields, msg_in, msg_size);
-		msg_pos = 0;
-		read_state = READSTATE_IDLE;
+#if USE_ETHEREUM
+	if (r->stream && (tiny || !msg_queue_empty())) {
+		// the message will be queued now, drop what was hashed of it
+		r->stream = false;
+		ethereum_signing_stream_begin();
+	}
+	if (r->stream) {
+		uint32_t end = r->msg_pos < r->msg_size ? r->msg_pos : r->msg_size;
+		ethereum_signing_stream(r->msg_in + r->stream_pos, end - r->stream_pos);
+		r->stream_pos = end;
+	}
+#endif
+
+	if (r->msg_pos >= r->msg_size) {
+		if (tiny || !msg_queue_empty()) {
+			// keep the order of messages still waiting in the queue
+			if (!msg_queue_push(type, r->msg_id, r->msg_in, r->msg_size)) {
+				fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("Message queue full"));
+			}
+		} else {
+			if (!msg_process(type, r->msg_id, r->fields, r->msg_in, r->msg_size)) {
+				msg_stream_abort(r);
+			}
+		}
+		r->msg_pos = 0;
+		r->read_state = READSTATE_IDLE;
 	}
 }
 
+void msg_read_common(char type, const uint8_t *buf, int len)
+{
+	msg_read_packet(type, buf, len, false);
+}
+
 const uint8_t *msg_out_data(void)
 {
+	uint32_t depth = (msg_out_end + MSG_OUT_SIZE / 64 - msg_out_start) % (MSG_OUT_SIZE / 64);
+	if (depth > usb_stats.out_depth_max) {
+		usb_stats.out_depth_max = depth;
+	}
+	if (depth > 0) {
+		usb_stats.out_depth_sum += depth;
+		usb_stats.out_depth_samples++;
+	}
 	if (msg_out_start == msg_out_end) return 0;
 	uint8_t *data = msg_out + (msg_out_start * 64);
 	msg_out_start = (msg_out_start + 1) % (MSG_OUT_SIZE / 64);
@@ -312,26 +609,38 @@ const uint8_t *msg_debug_out_data(void)
 	return data;
 }
 
+// number of 64-byte packets that can still be queued on the debug link
+uint32_t msg_debug_out_free(void)
+{
+	uint32_t depth = (msg_debug_out_end + MSG_DEBUG_OUT_SIZE / 64 - msg_debug_out_start) % (MSG_DEBUG_OUT_SIZE / 64);
+	return MSG_DEBUG_OUT_SIZE / 64 - 1 - depth - (msg_debug_out_cur ? 1 : 0);
+}
+
 #endif
 
 CONFIDENTIAL uint8_t msg_tiny[64];
 uint16_t msg_tiny_id = 0xFFFF;
 
-void msg_read_tiny(const uint8_t *buf, int len)
+void msg_read_tiny_common(char type, const uint8_t *buf, int len)
 {
 	if (len != 64) return;
-	if (buf[0] != '?' || buf[1] != '#' || buf[2] != '#') {
+	if (msg_reader_get(type)->read_state == READSTATE_READING) {
+		// continuation of a message which is queued
+		msg_read_packet(type, buf, len, true);
 		return;
 	}
-	uint16_t msg_id = (buf[3] << 8) + buf[4];
-	uint32_t msg_size = (buf[5] << 24) + (buf[6] << 16) + (buf[7] << 8) + buf[8];
-	if (msg_size > 64 || len - msg_size < 9) {
+	if (buf[0] != '?' || buf[1] != '#' || (buf[2] != '#' && buf[2] != '%')) {
+		return;
+	}
+	if (buf[2] == '%') {
+		// tiny messages are never compressed
+		msg_read_packet(type, buf, len, true);
 		return;
 	}
+	uint16_t msg_id = (buf[3] << 8) + buf[4];
+	uint32_t msg_size = (buf[5] << 24) + (buf[6] << 16) + (buf[7] << 8) + buf[8];
 
 	const pb_field_t *fields = 0;
-	// upstream nanopb is missing const qualifier, so we have to cast :-/
-	pb_istream_t stream = pb_istream_from_buffer((uint8_t *)buf + 9, msg_size);
 
 	switch (msg_id) {
 		case MessageType_MessageType_PinMatrixAck:
@@ -358,16 +667,25 @@ void msg_read_tiny(const uint8_t *buf, int len)
 			break;
 #endif
 	}
-	if (fields) {
-		bool status = pb_decode(&stream, fields, msg_tiny);
-		if (status) {
-			msg_tiny_id = msg_id;
-		} else {
-			fsm_sendFailure(FailureType_Failure_DataError, stream.errmsg);
-			msg_tiny_id = 0xFFFF;
+	if (!fields) {
+		// not a tiny message, queue it until the workflow finishes
+		msg_read_packet(type, buf, len, true);
+		return;
+	}
+	if (msg_size > 64 || len - msg_size < 9) {
+		return;
+	}
+	// upstream nanopb is missing const qualifier, so we have to cast :-/
+	pb_istream_t stream = pb_istream_from_buffer((uint8_t *)buf + 9, msg_size);
+	bool status = pb_decode(&stream, fields, msg_tiny);
+	if (status) {
+		msg_tiny_id = msg_id;
+		if (msg_id == MessageType_MessageType_Initialize) {
+			// host restarts the session, drop its pipelined requests
+			msg_queue_clear();
 		}
 	} else {
-		fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("Unknown message"));
+		fsm_sendFailure(FailureType_Failure_DataError, stream.errmsg);
 		msg_tiny_id = 0xFFFF;
 	}
 }
@@ -28,25 +28,34 @@
 
 #define MSG_OUT_SIZE (12*1024)
 
+#define MSG_QUEUE_SIZE (2*1024)
+
 #define msg_read(buf, len) msg_read_common('n', (buf), (len))
 #define msg_write(id, ptr) msg_write_common('n', (id), (ptr))
 const uint8_t *msg_out_data(void);
 
 #if DEBUG_LINK
 
+#define MSG_DEBUG_IN_SIZE (2*1024)
+
 #define MSG_DEBUG_OUT_SIZE (4*1024)
 
 #define msg_debug_read(buf, len) msg_read_common('d', (buf), (len))
 #define msg_debug_write(id, ptr) msg_write_common('d', (id), (ptr))
 const uint8_t *msg_debug_out_data(void);
+uint32_t msg_debug_out_free(void);
 
 #endif
 
 void msg_read_common(char type, const uint8_t *buf, int len);
 bool msg_write_common(char type, uint16_t msg_id, const void *msg_ptr);
 
-void msg_read_tiny(const uint8_t *buf, int len);
-void msg_debug_read_tiny(const uint8_t *buf, int len);
+#define msg_read_tiny(buf, len) msg_read_tiny_common('n', (buf), (len))
+#define msg_debug_read_tiny(buf, len) msg_read_tiny_common('d', (buf), (len))
+void msg_read_tiny_common(char type, const uint8_t *buf, int len);
+
+void msg_queue_dispatch(void);
+void msg_queue_clear(void);
 extern uint8_t msg_tiny[64];
 extern uint16_t msg_tiny_id;
 
@@ -27,6 +27,15 @@
 #include "rng.h"
 #include "secp256k1.h"
 
+#define NEM_MESSAGE_TYPE_ENCRYPTED    0x02
+
+static void nem_write_u32_le(uint8_t *out, uint32_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+	out[2] = value >> 16;
+	out[3] = value >> 24;
+}
+
 const char *nem_validate_common(NEMTransactionCommon *common, bool inner) {
 	if (!common->has_network) {
 		common->has_network = true;
@@ -251,17 +260,55 @@ bool nem_askTransfer(const NEMTransactionCommon *common, const NEMTransfer *tran
 }
 
 bool nem_fsmTransfer(nem_transaction_ctx *context, const HDNode *node, const NEMTransactionCommon *common, const NEMTransfer *transfer) {
-	static uint8_t encrypted[NEM_ENCRYPTED_PAYLOAD_SIZE(sizeof(transfer->payload.bytes))];
+	if (transfer->has_public_key && node == NULL) {
+		fsm_sendFailure(FailureType_Failure_ProcessError, _("Private key unavailable for encrypted message"));
+		return false;
+	}
 
-	const uint8_t *payload = transfer->payload.bytes;
-	size_t size = transfer->payload.size;
+	/* An encrypted payload is encrypted straight to where it is serialized.
+	 * The transfer is written without a message first, which ends with the
+	 * (zero) message length and the mosaic count, and the message is built
+	 * in their place. */
+	bool in_place = transfer->has_public_key;
 
-	if (transfer->has_public_key) {
-		if (node == NULL) {
-			fsm_sendFailure(FailureType_Failure_ProcessError, _("Private key unavailable for encrypted message"));
+	bool ret = nem_transaction_create_transfer(context,
+			common->network,
+			common->timestamp,
+			NULL,
+			common->fee,
+			common->deadline,
+			transfer->recipient,
+			transfer->amount,
+			in_place ? NULL : transfer->payload.bytes,
+			in_place ? 0 : transfer->payload.size,
+			transfer->has_public_key,
+			transfer->mosaics_count);
+
+	if (!ret) {
+		fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to create transfer transaction"));
+		return false;
+	}
+
+	if (in_place) {
+		size_t start = context->offset - sizeof(uint32_t);
+		if (transfer->mosaics_count) {
+			start -= sizeof(uint32_t);
+		}
+		size_t size = NEM_ENCRYPTED_PAYLOAD_SIZE(transfer->payload.size);
+
+		// message length, type and payload length, then the payload
+		size_t end = start + 3 * sizeof(uint32_t) + size;
+		if (transfer->mosaics_count) {
+			end += sizeof(uint32_t);
+		}
+		if (end > context->size) {
+			fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to create transfer transaction"));
 			return false;
 		}
 
+		uint8_t *message = &context->buffer[start];
+		uint8_t *encrypted = &message[3 * sizeof(uint32_t)];
+
 		random_buffer(encrypted, NEM_SALT_SIZE + AES_BLOCK_SIZE);
 
 		// hdnode_nem_encrypt mutates the IV
@@ -271,12 +318,12 @@ bool nem_fsmTransfer(nem_transaction_ctx *context, const HDNode *node, const NEM
 		const uint8_t *salt = encrypted;
 		uint8_t *buffer = &encrypted[NEM_SALT_SIZE + AES_BLOCK_SIZE];
 
-		bool ret = hdnode_nem_encrypt(node,
+		ret = hdnode_nem_encrypt(node,
 				transfer->public_key.bytes,
 				iv,
 				salt,
-				payload,
-				size,
+				transfer->payload.bytes,
+				transfer->payload.size,
 				buffer);
 
 		if (!ret) {
@@ -284,26 +331,13 @@ bool nem_fsmTransfer(nem_transaction_ctx *context, const HDNode *node, const NEM
 			return false;
 		}
 
-		payload = encrypted;
-		size = NEM_ENCRYPTED_PAYLOAD_SIZE(size);
-	}
-
-	bool ret = nem_transaction_create_transfer(context,
-			common->network,
-			common->timestamp,
-			NULL,
-			common->fee,
-			common->deadline,
-			transfer->recipient,
-			transfer->amount,
-			payload,
-			size,
-			transfer->has_public_key,
-			transfer->mosaics_count);
-
-	if (!ret) {
-		fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to create transfer transaction"));
-		return false;
+		nem_write_u32_le(&message[0], sizeof(uint32_t) + sizeof(uint32_t) + size);
+		nem_write_u32_le(&message[4], NEM_MESSAGE_TYPE_ENCRYPTED);
+		nem_write_u32_le(&message[8], size);
+		if (transfer->mosaics_count) {
+			nem_write_u32_le(&context->buffer[end - sizeof(uint32_t)], transfer->mosaics_count);
+		}
+		context->offset = end;
 	}
 
 	for (size_t i = 0; i < transfer->mosaics_count; i++) {
@@ -669,7 +703,63 @@ bool nem_askMultisig(const char *address, const char *desc, bool cosigning, uint
 	return true;
 }
 
-bool nem_fsmMultisig(nem_transaction_ctx *context, const NEMTransactionCommon *common, const nem_transaction_ctx *inner, bool cosigning) {
+/*
+ * The inner transaction of a multisig transaction is serialized in place,
+ * directly behind the outer one in the same buffer.  A multisig transaction
+ * embeds the inner one length-prefixed, so the outer part is written first
+ * with an empty inner transaction and the length is patched in by
+ * nem_fsmMultisigFinish.  A multisig signature only carries the hash of the
+ * inner transaction, which is built past the space the outer one needs.
+ */
+bool nem_fsmMultisigStart(nem_transaction_ctx *context, const NEMTransactionCommon *common, const uint8_t *signer, nem_transaction_ctx *inner, bool cosigning) {
+	size_t start = context->offset;
+	size_t offset;
+
+	nem_transaction_ctx empty;
+	nem_transaction_start(&empty, signer, context->buffer, 0);
+
+	if (cosigning) {
+		// the size of a signature does not depend on the inner transaction,
+		// so it is measured with an empty one and written again once the
+		// inner transaction is known
+		if (!nem_transaction_create_multisig_signature(context,
+				common->network,
+				common->timestamp,
+				NULL,
+				common->fee,
+				common->deadline,
+				&empty)) {
+			fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to create multisig transaction"));
+			return false;
+		}
+
+		offset = context->offset;
+		context->offset = start;
+	} else {
+		if (!nem_transaction_create_multisig(context,
+				common->network,
+				common->timestamp,
+				NULL,
+				common->fee,
+				common->deadline,
+				&empty)) {
+			fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to create multisig transaction"));
+			return false;
+		}
+
+		offset = context->offset;
+	}
+
+	if (offset > context->size) {
+		fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to create multisig transaction"));
+		return false;
+	}
+
+	nem_transaction_start(inner, signer, &context->buffer[offset], context->size - offset);
+	return true;
+}
+
+bool nem_fsmMultisigFinish(nem_transaction_ctx *context, const NEMTransactionCommon *common, const nem_transaction_ctx *inner, bool cosigning) {
 	bool ret;
 	if (cosigning) {
 		ret = nem_transaction_create_multisig_signature(context,
@@ -679,14 +769,15 @@ bool nem_fsmMultisig(nem_transaction_ctx *context, const NEMTransactionCommon *c
 			common->fee,
 			common->deadline,
 			inner);
+
+		// the outer transaction must not have run into the inner one
+		ret = ret && &context->buffer[context->offset] <= inner->buffer;
 	} else {
-		ret = nem_transaction_create_multisig(context,
-			common->network,
-			common->timestamp,
-			NULL,
-			common->fee,
-			common->deadline,
-			inner);
+		// patch the length of the inner transaction
+		nem_write_u32_le(&context->buffer[context->offset - sizeof(uint32_t)], inner->offset);
+
+		context->offset += inner->offset;
+		ret = true;
 	}
 
 	if (!ret) {
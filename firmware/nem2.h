@@ -55,7 +55,8 @@ bool nem_askImportanceTransfer(const NEMTransactionCommon *common, const NEMImpo
 bool nem_fsmImportanceTransfer(nem_transaction_ctx *context, const NEMTransactionCommon *common, const NEMImportanceTransfer *importance_transfer);
 
 bool nem_askMultisig(const char *address, const char *desc, bool cosigning, uint64_t fee);
-bool nem_fsmMultisig(nem_transaction_ctx *context, const NEMTransactionCommon *common, const nem_transaction_ctx *inner, bool cosigning);
+bool nem_fsmMultisigStart(nem_transaction_ctx *context, const NEMTransactionCommon *common, const uint8_t *signer, nem_transaction_ctx *inner, bool cosigning);
+bool nem_fsmMultisigFinish(nem_transaction_ctx *context, const NEMTransactionCommon *common, const nem_transaction_ctx *inner, bool cosigning);
 
 const NEMMosaicDefinition *nem_mosaicByName(const char *namespace, const char *mosaic, uint8_t network);
 
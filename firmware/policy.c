@@ -0,0 +1,121 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2014 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+
+#include "policy.h"
+#include "storage.h"
+#include "transaction.h"
+#include "bip32.h"
+#include "secp256k1.h"
+#include "memzero.h"
+
+/*
+ * The spending policy lets signing skip the output and fee confirmations
+ * for transactions the user has agreed to in advance (ApplyPolicy).
+ * Every external output has to pay to an address derived (non-hardened)
+ * from one of the destination xpubs, and the amount and fee rate have
+ * to stay within the policy limits.  Everything else is confirmed as usual.
+ * Only Bitcoin-style signing (signing.c) looks at the policy; Ethereum
+ * and the other coins always ask for confirmation.
+ */
+
+static const StoragePolicy *policy_get(const CoinInfo *coin)
+{
+	const StoragePolicy *policy = storage_getPolicy();
+	if (!policy || strcmp(policy->coin_name, coin->coin_name) != 0) {
+		return NULL;
+	}
+	return policy;
+}
+
+/* coins signed by signing.c with base58 addresses on secp256k1 */
+bool policy_coinSupported(const CoinInfo *coin)
+{
+	return coin->has_address_type && coin->curve == &secp256k1_info;
+}
+
+static const InputScriptType policy_script_types[] = {
+	InputScriptType_SPENDADDRESS,
+	InputScriptType_SPENDP2SHWITNESS,
+	InputScriptType_SPENDWITNESS,
+};
+
+bool policy_checkOutput(const CoinInfo *coin, const TxOutputType *output)
+{
+	const StoragePolicy *policy = policy_get(coin);
+	if (!policy) {
+		return false;
+	}
+	if (!output->has_address || output->has_multisig || output->script_type != OutputScriptType_PAYTOADDRESS) {
+		return false;
+	}
+	if (!output->has_policy_index || output->policy_index >= policy->destinations_count) {
+		return false;
+	}
+	if (output->amount > policy->max_amount) {
+		return false;
+	}
+
+	const StoragePolicyNode *dest = &policy->destinations[output->policy_index];
+	HDNode node;
+	if (hdnode_from_xpub(0, 0, dest->chain_code, dest->public_key, coin->curve_name, &node) == 0) {
+		return false;
+	}
+	for (uint32_t i = 0; i < output->policy_path_count; i++) {
+		if ((output->policy_path[i] & 0x80000000) || hdnode_public_ckd(&node, output->policy_path[i]) == 0) {
+			memzero(&node, sizeof(node));
+			return false;
+		}
+	}
+
+	bool matches = false;
+	char address[MAX_ADDR_SIZE];
+	for (size_t i = 0; i < sizeof(policy_script_types) / sizeof(policy_script_types[0]) && !matches; i++) {
+		if (!(policy->script_types & (1 << policy_script_types[i]))) {
+			continue;
+		}
+		if (compute_address(coin, policy_script_types[i], &node, false, NULL, address)) {
+			matches = strcmp(address, output->address) == 0;
+		}
+	}
+	memzero(&node, sizeof(node));
+	return matches;
+}
+
+/* amount is what leaves the wallet, fee included */
+bool policy_checkTx(const CoinInfo *coin, uint64_t amount, uint64_t fee, uint32_t tx_weight)
+{
+	const StoragePolicy *policy = policy_get(coin);
+	if (!policy) {
+		return false;
+	}
+	if (amount > policy->max_amount) {
+		return false;
+	}
+	uint64_t spent = storage_getPolicySpent();
+	if (spent > policy->total_amount || amount > policy->total_amount - spent) {
+		return false;
+	}
+	if (fee > ((uint64_t) tx_weight * policy->max_fee_per_kb) / 4000) {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of the TREZOR project, https://trezor.io/
+ *
+ * Copyright (C) 2014 Pavol Rusnak <stick@satoshilabs.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "coins.h"
+#include "types.pb.h"
+
+bool policy_coinSupported(const CoinInfo *coin);
+bool policy_checkOutput(const CoinInfo *coin, const TxOutputType *output);
+bool policy_checkTx(const CoinInfo *coin, uint64_t amount, uint64_t fee, uint32_t tx_weight);
+
+#endif
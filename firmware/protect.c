@@ -33,13 +33,46 @@
 
 #define MAX_WRONG_PINS 15
 
+#if AUTOCONFIRM && !EMULATOR
+#error "AUTOCONFIRM is only supported by the emulator"
+#endif
+
 bool protectAbortedByInitialize = false;
 
+/* The host declared in the message that started the current workflow
+ * (SignTx, ResetDevice, RecoveryDevice) that it acknowledges all button
+ * requests in advance.  ButtonRequest is still sent, but only as a
+ * notification, and the buttons count at once.
+ */
+bool protectPreAcked = false;
+
+// called for every message processed outside of tiny mode; a message
+// that does not continue the current workflow ends the pre-acknowledgement
+void protectPreAckUpdate(uint16_t msg_id)
+{
+	switch (msg_id) {
+		case MessageType_MessageType_TxAck:
+		case MessageType_MessageType_EntropyAck:
+		case MessageType_MessageType_WordAck:
+			break;
+		default:
+			protectPreAcked = false;
+			break;
+	}
+}
+
 bool protectButton(ButtonRequestType type, bool confirm_only)
 {
+#if AUTOCONFIRM
+	// confirm every dialog, used to drive the message handlers in-process
+	(void)type;
+	(void)confirm_only;
+	return true;
+#endif
+
 	ButtonRequest resp;
 	bool result = false;
-	bool acked = false;
+	bool acked = protectPreAcked;
 #if DEBUG_LINK
 	bool debug_decided = false;
 #endif
@@ -21,6 +21,7 @@
 #define __PROTECT_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "types.pb.h"
 
 bool protectButton(ButtonRequestType type, bool confirm_only);
@@ -28,6 +29,9 @@ bool protectPin(bool use_cached);
 bool protectChangePin(void);
 bool protectPassphrase(void);
 
+void protectPreAckUpdate(uint16_t msg_id);
+
 extern bool protectAbortedByInitialize;
+extern bool protectPreAcked;
 
 #endif
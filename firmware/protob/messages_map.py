@@ -6,6 +6,12 @@ from types_pb2 import wire_in, wire_out, wire_debug_in, wire_debug_out, wire_tin
 # len("MessageType_MessageType_") - len("_fields") == 17
 TEMPLATE = "\t{{ {type} {dir} {msg_id:46} {fields:29} {process_func} }},"
 
+# messages of coin families which can be left out of the build
+FEATURES = (
+    ("Ethereum", "USE_ETHEREUM"),
+    ("NEM", "USE_NEM"),
+)
+
 LABELS = {
     wire_in: "in messages",
     wire_out: "out messages",
@@ -32,7 +38,7 @@ def handle_message(message, extension):
     if tiny:
         return '\t// Message %s is used in tiny mode' % short_name
 
-    return TEMPLATE.format(
+    entry = TEMPLATE.format(
         type="'%c'," % interface,
         dir="'%c'," % direction,
         msg_id="MessageType_%s," % name,
@@ -40,6 +46,12 @@ def handle_message(message, extension):
         process_func = "(void (*)(void *)) fsm_msg%s" % short_name if direction == "i" else "0"
     )
 
+    for prefix, define in FEATURES:
+        if short_name.startswith(prefix):
+            return "#if %s\n%s\n#endif" % (define, entry)
+
+    return entry
+
 print('\t// This file is automatically generated by messages_map.py -- DO NOT EDIT!')
 
 messages = defaultdict(list)
@@ -20,6 +20,7 @@
 
 #include <ctype.h>
 #include "recovery.h"
+#include "reset.h"
 #include "fsm.h"
 #include "storage.h"
 #include "layout2.h"
@@ -148,7 +149,7 @@ static void recovery_done(void) {
 				// not enforcing => mark storage as imported
 				storage_setImported(true);
 			}
-			storage_update();
+			storage_end();
 			fsm_sendSuccess(_("Device recovered"));
 		} else {
 			// Inform the user about new mnemonic correctness (as well as whether it is the same as the current one).
@@ -175,7 +176,7 @@ static void recovery_done(void) {
 		// New mnemonic is invalid.
 		memzero(new_mnemonic, sizeof(new_mnemonic));
 		if (!dry_run) {
-			session_clear(true);
+			storage_abort();
 		} else {
 			layoutDialog(&bmp_icon_error, NULL, _("Confirm"), NULL,
 				_("The seed is"), _("INVALID!"), NULL, NULL, NULL, NULL);
@@ -409,12 +410,23 @@ void recovery_init(uint32_t _word_count, bool passphrase_protection, bool pin_pr
 {
 	if (_word_count != 12 && _word_count != 18 && _word_count != 24) return;
 
+	// a reset or recovery left waiting for its next message is replaced
+	recovery_abort();
+	reset_abort();
+
 	word_count = _word_count;
 	enforce_wordlist = _enforce_wordlist;
 	dry_run = _dry_run;
 
 	if (!dry_run) {
+		// written at once when the seed has been entered
+		if (!storage_begin(MessageType_MessageType_RecoveryDevice)) {
+			fsm_sendFailure(FailureType_Failure_ProcessError, _("Storage busy"));
+			layoutHome();
+			return;
+		}
 		if (pin_protection && !protectChangePin()) {
+			storage_abort();
 			fsm_sendFailure(FailureType_Failure_PinMismatch, NULL);
 			layoutHome();
 			return;
@@ -449,11 +461,8 @@ static void recovery_scrambledword(const char *word)
 {
 	if (word_pos == 0) { // fake word
 		if (strcmp(word, fake_word) != 0) {
-			if (!dry_run) {
-				session_clear(true);
-			}
 			fsm_sendFailure(FailureType_Failure_ProcessError, _("Wrong word retyped"));
-			layoutHome();
+			recovery_abort();
 			return;
 		}
 	} else { // real word
@@ -468,11 +477,8 @@ static void recovery_scrambledword(const char *word)
 				wl++;
 			}
 			if (!found) {
-				if (!dry_run) {
-					session_clear(true);
-				}
 				fsm_sendFailure(FailureType_Failure_DataError, _("Word not found in a wordlist"));
-				layoutHome();
+				recovery_abort();
 				return;
 			}
 		}
@@ -510,6 +516,7 @@ void recovery_word(const char *word)
 void recovery_abort(void)
 {
 	if (awaiting_word) {
+		storage_abort();
 		layoutHome();
 		awaiting_word = 0;
 	}
@@ -18,6 +18,7 @@
  */
 
 #include "reset.h"
+#include "recovery.h"
 #include "storage.h"
 #include "rng.h"
 #include "sha2.h"
@@ -39,6 +40,10 @@ void reset_init(bool display_random, uint32_t _strength, bool passphrase_protect
 {
 	if (_strength != 128 && _strength != 192 && _strength != 256) return;
 
+	// a reset or recovery left waiting for its next message is replaced
+	reset_abort();
+	recovery_abort();
+
 	strength = _strength;
 	skip_backup = _skip_backup;
 
@@ -59,7 +64,15 @@ void reset_init(bool display_random, uint32_t _strength, bool passphrase_protect
 		}
 	}
 
+	// everything up to the backup is written at once
+	if (!storage_begin(MessageType_MessageType_ResetDevice)) {
+		fsm_sendFailure(FailureType_Failure_ProcessError, _("Storage busy"));
+		layoutHome();
+		return;
+	}
+
 	if (pin_protection && !protectChangePin()) {
+		storage_abort();
 		fsm_sendFailure(FailureType_Failure_PinMismatch, NULL);
 		layoutHome();
 		return;
@@ -94,7 +107,7 @@ void reset_entropy(const uint8_t *ext_entropy, uint32_t len)
 	awaiting_entropy = false;
 
 	if (skip_backup) {
-		storage_update();
+		storage_end();
 		fsm_sendSuccess(_("Device successfully initialized"));
 		layoutHome();
 	} else {
@@ -103,6 +116,15 @@ void reset_entropy(const uint8_t *ext_entropy, uint32_t len)
 
 }
 
+void reset_abort(void)
+{
+	if (awaiting_entropy) {
+		awaiting_entropy = false;
+		memset(int_entropy, 0, sizeof(int_entropy));
+		storage_abort();
+	}
+}
+
 static char current_word[10];
 
 // separated == true if called as a separate workflow via BackupMessage
@@ -137,8 +159,7 @@ void reset_backup(bool separated)
 			layoutResetWord(current_word, pass, word_pos, mnemonic[i] == 0);
 			if (!protectButton(ButtonRequestType_ButtonRequest_ConfirmWord, true)) {
 				if (!separated) {
-					storage_clear_update();
-					session_clear(true);
+					storage_abort();
 				}
 				layoutHome();
 				fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
@@ -151,7 +172,7 @@ void reset_backup(bool separated)
 	if (separated) {
 		fsm_sendSuccess(_("Seed successfully backed up"));
 	} else {
-		storage_update();
+		storage_end();
 		fsm_sendSuccess(_("Device successfully initialized"));
 	}
 	layoutHome();
@@ -27,6 +27,15 @@
 #include "crypto.h"
 #include "secp256k1.h"
 #include "gettext.h"
+#include "timer.h"
+#include "util.h"
+#include "policy.h"
+#include "storage.h"
+#include "rng.h"
+#include "memzero.h"
+#if EMULATOR
+#include <stdio.h>
+#endif
 
 static uint32_t inputs_count;
 static uint32_t outputs_count;
@@ -40,6 +49,7 @@ enum {
 	STAGE_REQUEST_2_PREV_INPUT,
 	STAGE_REQUEST_2_PREV_OUTPUT,
 	STAGE_REQUEST_2_PREV_EXTRADATA,
+	STAGE_REQUEST_2_PREV_RAW,
 	STAGE_REQUEST_3_OUTPUT,
 	STAGE_REQUEST_4_INPUT,
 	STAGE_REQUEST_4_OUTPUT,
@@ -47,12 +57,16 @@ enum {
 	STAGE_REQUEST_5_OUTPUT,
 	STAGE_REQUEST_SEGWIT_WITNESS
 } signing_stage;
+_Static_assert(STAGE_REQUEST_SEGWIT_WITNESS + 1 == SIGNING_STAGE_COUNT, "SIGNING_STAGE_COUNT out of date");
+SigningStats signing_stats;
+static uint32_t stats_start_ms, stats_request_ms;
 static uint32_t idx1, idx2;
 static uint32_t signatures;
 static TxRequest resp;
 static TxInputType input;
 static TxOutputBinType bin_output;
 static TxStruct to, tp, ti;
+static TxRawStream tp_raw;
 static Hasher hashers[3];
 static uint8_t CONFIDENTIAL privkey[32];
 static uint8_t pubkey[33], sig[64];
@@ -68,6 +82,56 @@ static uint8_t multisig_fp[32];
 static uint32_t in_address_n[8];
 static size_t in_address_n_count;
 static uint32_t tx_weight;
+/* all external outputs so far are covered by the spending policy */
+static bool policy_outputs;
+/* Outputs that the policy let through without a confirmation.  If the
+ * policy does not cover the whole transaction after all, they are shown
+ * before the user confirms the total.  Outputs beyond the limit are
+ * confirmed right away.
+ */
+#define POLICY_SKIPPED_MAX 4
+typedef struct {
+	uint64_t amount;
+	char address[sizeof(((TxOutputType *)0)->address)];
+} PolicySkippedOutput;
+static PolicySkippedOutput policy_skipped[POLICY_SKIPPED_MAX];
+static uint32_t policy_skipped_count;
+
+/* Signing state saved before every input and output request of phase 1
+ * and before phase 2 starts.  A SignTx retried after a transport failure
+ * goes on from there instead of asking for all confirmations again (see
+ * signing_init).  Per-request state (input, tp, ti, ...) is rebuilt by
+ * the resent request, and no private key is kept.
+ */
+static struct {
+	bool valid;
+	uint8_t token[SIGNING_RESUME_TOKEN_SIZE];
+	uint32_t suspended_ms;
+	void (*resend)(void);
+	// the retried SignTx has to match these
+	uint32_t inputs_count, outputs_count, version, lock_time;
+	const CoinInfo *coin;
+	uint8_t root_chain_code[32];
+	// state as of the checkpoint
+	uint32_t idx1, signatures;
+	TxStruct to;
+	Hasher hashers[3];
+	uint8_t hash_prevouts[32], hash_sequence[32], hash_outputs[32], hash_check[32];
+	uint64_t to_spend, authorized_amount, spending, change_spend;
+	uint32_t next_nonsegwit_input;
+	uint32_t progress, progress_step, progress_meta_step;
+	bool multisig_fp_set, multisig_fp_mismatch;
+	uint8_t multisig_fp[32];
+	uint32_t in_address_n[8];
+	size_t in_address_n_count;
+	uint32_t tx_weight;
+	bool policy_outputs;
+	PolicySkippedOutput policy_skipped[POLICY_SKIPPED_MAX];
+	uint32_t policy_skipped_count;
+} checkpoint;
+
+/* how long a suspended signing session can be resumed */
+#define SIGNING_RESUME_TIMEOUT_MS (60 * 1000)
 
 /* A marker for in_address_n_count to indicate a mismatch in bip32 paths in
    input */
@@ -87,6 +151,14 @@ static uint32_t tx_weight;
 /* transaction segwit overhead 2 marker */
 #define TXSIZE_SEGWIT_OVERHEAD 2
 
+/* Compact witness input in TransactionType.extra_data: prev_hash (32),
+   prev_index (4), sequence (4), amount (8), script_type (1),
+   address_n_count (1) and address_n (4 each), integers little endian */
+#define WITNESS_INPUT_HEADER_SIZE 50
+/* largest witness of a single signature input: item count, DER signature
+   with sighash and compressed public key, each with its length */
+#define WITNESS_MAX_SIZE (1 + 1 + 73 + 1 + 33)
+
 enum {
 	SIGHASH_ALL = 1,
 	SIGHASH_FORKID = 0x40,
@@ -124,6 +196,11 @@ foreach I (idx1):
             Add amount of prevhash O (which is amount of I)
         Request prevhash extra data (if applicable)                   STAGE_REQUEST_2_PREV_EXTRADATA
         Calculate hash of streamed tx, compare to prevhash I
+        If META announces raw_size, instead of the above:
+            foreach chunk of raw prevhash tx:
+                Request raw chunk                                     STAGE_REQUEST_2_PREV_RAW
+                Parse amount of output prev_index (which is amount of I)
+            Calculate hash of streamed tx, compare to prevhash I
 foreach O (idx1):
     Request O                                                         STAGE_REQUEST_3_OUTPUT
     Add O to TransactionChecksum
@@ -171,13 +248,20 @@ Phase3: sign segwit inputs, check that nothing changed
 
 foreach I (idx1):  // input to sign
     Request I                                                         STAGE_REQUEST_SEGWIT_WITNESS
+    (the host may answer with compact inputs I, I+1, ... in extra_data)
     Check amount
     Sign  segwit prevhash, sequence, amount, outputs
-    Return witness
+    Return witness (one per answered input)
+Compare prevouts and script types with checksum computed in Phase 1
+If different:
+    Failure
 */
 
+static void signing_checkpoint(void (*resend)(void));
+
 void send_req_1_input(void)
 {
+	signing_checkpoint(send_req_1_input);
 	signing_stage = STAGE_REQUEST_1_INPUT;
 	resp.has_request_type = true;
 	resp.request_type = RequestType_TXINPUT;
@@ -243,8 +327,25 @@ void send_req_2_prev_extradata(uint32_t chunk_offset, uint32_t chunk_len)
 	msg_write(MessageType_MessageType_TxRequest, &resp);
 }
 
+void send_req_2_prev_raw(uint32_t chunk_offset, uint32_t chunk_len)
+{
+	signing_stage = STAGE_REQUEST_2_PREV_RAW;
+	resp.has_request_type = true;
+	resp.request_type = RequestType_TXRAW;
+	resp.has_details = true;
+	resp.details.has_extra_data_offset = true;
+	resp.details.extra_data_offset = chunk_offset;
+	resp.details.has_extra_data_len = true;
+	resp.details.extra_data_len = chunk_len;
+	resp.details.has_tx_hash = true;
+	resp.details.tx_hash.size = input.prev_hash.size;
+	memcpy(resp.details.tx_hash.bytes, input.prev_hash.bytes, resp.details.tx_hash.size);
+	msg_write(MessageType_MessageType_TxRequest, &resp);
+}
+
 void send_req_3_output(void)
 {
+	signing_checkpoint(send_req_3_output);
 	signing_stage = STAGE_REQUEST_3_OUTPUT;
 	resp.has_request_type = true;
 	resp.request_type = RequestType_TXOUTPUT;
@@ -430,8 +531,102 @@ bool compile_input_script_sig(TxInputType *tinput)
 	return tinput->script_sig.size > 0;
 }
 
-void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinInfo *_coin, const HDNode *_root, uint32_t _version, uint32_t _lock_time)
+static void signing_checkpoint(void (*resend)(void))
+{
+	checkpoint.valid = true;
+	checkpoint.resend = resend;
+	checkpoint.inputs_count = inputs_count;
+	checkpoint.outputs_count = outputs_count;
+	checkpoint.version = version;
+	checkpoint.lock_time = lock_time;
+	checkpoint.coin = coin;
+	memcpy(checkpoint.root_chain_code, root->chain_code, 32);
+	checkpoint.idx1 = idx1;
+	checkpoint.signatures = signatures;
+	memcpy(&checkpoint.to, &to, sizeof(to));
+	memcpy(checkpoint.hashers, hashers, sizeof(hashers));
+	memcpy(checkpoint.hash_prevouts, hash_prevouts, 32);
+	memcpy(checkpoint.hash_sequence, hash_sequence, 32);
+	memcpy(checkpoint.hash_outputs, hash_outputs, 32);
+	memcpy(checkpoint.hash_check, hash_check, 32);
+	checkpoint.to_spend = to_spend;
+	checkpoint.authorized_amount = authorized_amount;
+	checkpoint.spending = spending;
+	checkpoint.change_spend = change_spend;
+	checkpoint.next_nonsegwit_input = next_nonsegwit_input;
+	checkpoint.progress = progress;
+	checkpoint.progress_step = progress_step;
+	checkpoint.progress_meta_step = progress_meta_step;
+	checkpoint.multisig_fp_set = multisig_fp_set;
+	checkpoint.multisig_fp_mismatch = multisig_fp_mismatch;
+	memcpy(checkpoint.multisig_fp, multisig_fp, 32);
+	memcpy(checkpoint.in_address_n, in_address_n, sizeof(in_address_n));
+	checkpoint.in_address_n_count = in_address_n_count;
+	checkpoint.tx_weight = tx_weight;
+	checkpoint.policy_outputs = policy_outputs;
+	memcpy(checkpoint.policy_skipped, policy_skipped, sizeof(policy_skipped));
+	checkpoint.policy_skipped_count = policy_skipped_count;
+}
+
+static bool signing_resume(const uint8_t *resume_token)
+{
+	if (!checkpoint.valid || memcmp(resume_token, checkpoint.token, SIGNING_RESUME_TOKEN_SIZE) != 0) {
+		return false;
+	}
+	if (timer_ms() - checkpoint.suspended_ms > SIGNING_RESUME_TIMEOUT_MS) {
+		signing_resume_clear();
+		return false;
+	}
+	// same transaction header, coin and wallet; the inputs and outputs
+	// are checked against the saved hashes in phase 2 as usual
+	if (checkpoint.inputs_count != inputs_count || checkpoint.outputs_count != outputs_count
+		|| checkpoint.version != version || checkpoint.lock_time != lock_time
+		|| checkpoint.coin != coin || memcmp(checkpoint.root_chain_code, root->chain_code, 32) != 0) {
+		return false;
+	}
+	idx1 = checkpoint.idx1;
+	signatures = checkpoint.signatures;
+	memcpy(&to, &checkpoint.to, sizeof(to));
+	memcpy(hashers, checkpoint.hashers, sizeof(hashers));
+	memcpy(hash_prevouts, checkpoint.hash_prevouts, 32);
+	memcpy(hash_sequence, checkpoint.hash_sequence, 32);
+	memcpy(hash_outputs, checkpoint.hash_outputs, 32);
+	memcpy(hash_check, checkpoint.hash_check, 32);
+	to_spend = checkpoint.to_spend;
+	authorized_amount = checkpoint.authorized_amount;
+	spending = checkpoint.spending;
+	change_spend = checkpoint.change_spend;
+	next_nonsegwit_input = checkpoint.next_nonsegwit_input;
+	progress = checkpoint.progress;
+	progress_step = checkpoint.progress_step;
+	progress_meta_step = checkpoint.progress_meta_step;
+	multisig_fp_set = checkpoint.multisig_fp_set;
+	multisig_fp_mismatch = checkpoint.multisig_fp_mismatch;
+	memcpy(multisig_fp, checkpoint.multisig_fp, 32);
+	memcpy(in_address_n, checkpoint.in_address_n, sizeof(in_address_n));
+	in_address_n_count = checkpoint.in_address_n_count;
+	tx_weight = checkpoint.tx_weight;
+	policy_outputs = checkpoint.policy_outputs;
+	memcpy(policy_skipped, checkpoint.policy_skipped, sizeof(policy_skipped));
+	policy_skipped_count = checkpoint.policy_skipped_count;
+	return true;
+}
+
+void signing_resume_clear(void)
 {
+	memzero(&checkpoint, sizeof(checkpoint));
+}
+
+/* With a resume_token from an earlier TxRequest, an interrupted session
+ * of the same transaction continues from its last checkpoint.  Otherwise
+ * (or if that is not possible) signing starts from scratch.
+ */
+void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinInfo *_coin, const HDNode *_root, uint32_t _version, uint32_t _lock_time, const uint8_t *resume_token)
+{
+	if (signing) {
+		signing_suspend();
+	}
+
 	inputs_count = _inputs_count;
 	outputs_count = _outputs_count;
 	coin = _coin;
@@ -453,6 +648,22 @@ void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinInf
 	memset(&resp, 0, sizeof(TxRequest));
 
 	signing = true;
+	memset(&signing_stats, 0, sizeof(signing_stats));
+	stats_start_ms = timer_ms();
+	stats_request_ms = stats_start_ms;
+
+	resp.has_resume_token = true;
+	resp.resume_token.size = SIGNING_RESUME_TOKEN_SIZE;
+	if (resume_token && signing_resume(resume_token)) {
+		memcpy(resp.resume_token.bytes, checkpoint.token, SIGNING_RESUME_TOKEN_SIZE);
+		layoutProgress(_("Signing transaction"), progress);
+		checkpoint.resend();
+		return;
+	}
+	signing_resume_clear();
+	random_buffer(checkpoint.token, SIGNING_RESUME_TOKEN_SIZE);
+	memcpy(resp.resume_token.bytes, checkpoint.token, SIGNING_RESUME_TOKEN_SIZE);
+
 	progress = 0;
 	// we step by 500/inputs_count per input in phase1 and phase2
 	// this means 50 % per phase.
@@ -461,6 +672,9 @@ void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinInf
 	in_address_n_count = 0;
 	multisig_fp_set = false;
 	multisig_fp_mismatch = false;
+	policy_outputs = true;
+	memzero(policy_skipped, sizeof(policy_skipped));
+	policy_skipped_count = 0;
 	next_nonsegwit_input = 0xffffffff;
 
 	tx_init(&to, inputs_count, outputs_count, version, lock_time, 0, coin->curve->hasher_type);
@@ -505,7 +719,7 @@ static bool signing_check_input(TxInputType *txinput) {
 	tx_sequence_hash(&hashers[1], txinput);
 	// hash prevout and script type to check it later (relevant for fee computation)
 	tx_prevout_hash(&hashers[2], txinput);
-	hasher_Update(&hashers[2], (const uint8_t *) &txinput->script_type, sizeof(&txinput->script_type));
+	hasher_Update(&hashers[2], (const uint8_t *) &txinput->script_type, sizeof(txinput->script_type));
 	return true;
 }
 
@@ -522,6 +736,26 @@ static bool signing_check_prevtx_hash(void) {
 	return true;
 }
 
+/* Shows the outputs the spending policy let through, once it is clear
+ * that the policy does not cover the transaction.
+ */
+static bool signing_confirm_skipped(void) {
+	for (uint32_t i = 0; i < policy_skipped_count; i++) {
+		uint32_t confirm_start = timer_ms();
+		layoutConfirmOutputAddress(coin, policy_skipped[i].amount, policy_skipped[i].address);
+		bool confirmed = protectButton(ButtonRequestType_ButtonRequest_ConfirmOutput, false);
+		signing_stats.confirm_ms += timer_ms() - confirm_start;
+		if (!confirmed) {
+			fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
+			signing_abort();
+			return false;
+		}
+	}
+	memzero(policy_skipped, sizeof(policy_skipped));
+	policy_skipped_count = 0;
+	return true;
+}
+
 static bool signing_check_output(TxOutputType *txoutput) {
 	// Phase1: Check outputs
 	//   add it to hash_outputs
@@ -576,7 +810,23 @@ static bool signing_check_output(TxOutputType *txoutput) {
 		return false;
 	}
 	spending += txoutput->amount;
-	int co = compile_output(coin, root, txoutput, &bin_output, !is_change);
+	bool needs_confirm = !is_change;
+	if (needs_confirm && policy_outputs) {
+		policy_outputs = policy_skipped_count < POLICY_SKIPPED_MAX && policy_checkOutput(coin, txoutput);
+		if (policy_outputs) {
+			policy_skipped[policy_skipped_count].amount = txoutput->amount;
+			memcpy(policy_skipped[policy_skipped_count].address, txoutput->address, sizeof(txoutput->address));
+			policy_skipped_count++;
+			needs_confirm = false;
+		} else if (!signing_confirm_skipped()) {
+			return false;
+		}
+	}
+	uint32_t confirm_start = timer_ms();
+	int co = compile_output(coin, root, txoutput, &bin_output, needs_confirm);
+	if (needs_confirm) {
+		signing_stats.confirm_ms += timer_ms() - confirm_start;
+	}
 	if (!is_change) {
 		layoutProgress(_("Signing transaction"), progress);
 	}
@@ -602,6 +852,15 @@ static bool signing_check_fee(void) {
 		return false;
 	}
 	uint64_t fee = to_spend - spending;
+	if (policy_outputs && policy_checkTx(coin, to_spend - change_spend, fee, tx_weight)) {
+		// counted before any signature leaves the device
+		storage_addPolicySpent(to_spend - change_spend);
+		return true;
+	}
+	if (!signing_confirm_skipped()) {
+		return false;
+	}
+	uint32_t confirm_start = timer_ms();
 	if (fee > ((uint64_t) tx_weight * coin->maxfee_kb)/4000) {
 		layoutFeeOverThreshold(coin, fee);
 		if (!protectButton(ButtonRequestType_ButtonRequest_FeeOverThreshold, false)) {
@@ -612,7 +871,9 @@ static bool signing_check_fee(void) {
 	}
 	// last confirmation
 	layoutConfirmTx(coin, to_spend - change_spend, fee);
-	if (!protectButton(ButtonRequestType_ButtonRequest_SignTx, false)) {
+	bool confirmed = protectButton(ButtonRequestType_ButtonRequest_SignTx, false);
+	signing_stats.confirm_ms += timer_ms() - confirm_start;
+	if (!confirmed) {
 		fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL);
 		signing_abort();
 		return false;
@@ -643,6 +904,7 @@ static void phase1_request_next_output(void) {
 		progress_meta_step = progress_step / (inputs_count + outputs_count);
 		layoutProgress(_("Signing transaction"), progress);
 		idx1 = 0;
+		signing_checkpoint(phase2_request_next_input);
 		phase2_request_next_input();
 	}
 }
@@ -668,7 +930,15 @@ static bool signing_sign_hash(TxInputType *txinput, const uint8_t* private_key,
 	resp.serialized.signature_index = idx1;
 	resp.serialized.has_signature = true;
 	resp.serialized.has_serialized_tx = true;
-	if (ecdsa_sign_digest(&secp256k1, private_key, hash, sig, NULL, NULL) != 0) {
+	uint32_t sign_start = timer_ms();
+	CT_SECRET(private_key, 32);
+	int sign_ret = ecdsa_sign_digest(&secp256k1, private_key, hash, sig, NULL, NULL);
+	CT_PUBLIC(private_key, 32);
+	CT_PUBLIC(sig, sizeof(sig));
+	CT_PUBLIC(&sign_ret, sizeof(sign_ret));
+	signing_stats.sign_ms += timer_ms() - sign_start;
+	signing_stats.signatures++;
+	if (sign_ret != 0) {
 		fsm_sendFailure(FailureType_Failure_ProcessError, _("Signing failed"));
 		signing_abort();
 		return false;
@@ -719,7 +989,9 @@ static bool signing_sign_input(void) {
 
 static bool signing_sign_segwit_input(TxInputType *txinput) {
 	// idx1: index to sign
+	// the witness is appended to resp.serialized.serialized_tx
 	uint8_t hash[32];
+	uint8_t *out = resp.serialized.serialized_tx.bytes + resp.serialized.serialized_tx.size;
 
 	if (txinput->script_type == InputScriptType_SPENDWITNESS
 		|| txinput->script_type == InputScriptType_SPENDP2SHWITNESS) {
@@ -744,7 +1016,7 @@ static bool signing_sign_segwit_input(TxInputType *txinput) {
 		uint8_t sighash = signing_hash_type() & 0xff;
 		if (txinput->has_multisig) {
 			uint32_t r = 1; // skip number of items (filled in later)
-			resp.serialized.serialized_tx.bytes[r] = 0; r++;
+			out[r] = 0; r++;
 			int nwitnesses = 2;
 			for (uint32_t i = 0; i < txinput->multisig.signatures_count; i++) {
 				if (txinput->multisig.signatures[i].size == 0) {
@@ -752,20 +1024,20 @@ static bool signing_sign_segwit_input(TxInputType *txinput) {
 				}
 				nwitnesses++;
 				txinput->multisig.signatures[i].bytes[txinput->multisig.signatures[i].size] = sighash;
-				r += tx_serialize_script(txinput->multisig.signatures[i].size + 1, txinput->multisig.signatures[i].bytes, resp.serialized.serialized_tx.bytes + r);
+				r += tx_serialize_script(txinput->multisig.signatures[i].size + 1, txinput->multisig.signatures[i].bytes, out + r);
 			}
 			uint32_t script_len = compile_script_multisig(&txinput->multisig, 0);
-			r += ser_length(script_len, resp.serialized.serialized_tx.bytes + r);
-			r += compile_script_multisig(&txinput->multisig, resp.serialized.serialized_tx.bytes + r);
-			resp.serialized.serialized_tx.bytes[0] = nwitnesses;
-			resp.serialized.serialized_tx.size = r;
+			r += ser_length(script_len, out + r);
+			r += compile_script_multisig(&txinput->multisig, out + r);
+			out[0] = nwitnesses;
+			resp.serialized.serialized_tx.size += r;
 		} else { // single signature
 			uint32_t r = 0;
-			r += ser_length(2, resp.serialized.serialized_tx.bytes + r);
+			r += ser_length(2, out + r);
 			resp.serialized.signature.bytes[resp.serialized.signature.size] = sighash;
-			r += tx_serialize_script(resp.serialized.signature.size + 1, resp.serialized.signature.bytes, resp.serialized.serialized_tx.bytes + r);
-			r += tx_serialize_script(33, node.public_key, resp.serialized.serialized_tx.bytes + r);
-			resp.serialized.serialized_tx.size = r;
+			r += tx_serialize_script(resp.serialized.signature.size + 1, resp.serialized.signature.bytes, out + r);
+			r += tx_serialize_script(33, node.public_key, out + r);
+			resp.serialized.serialized_tx.size += r;
 		}
 	} else {
 		// empty witness
@@ -773,8 +1045,8 @@ static bool signing_sign_segwit_input(TxInputType *txinput) {
 		resp.serialized.has_signature_index = false;
 		resp.serialized.has_signature = false;
 		resp.serialized.has_serialized_tx = true;
-		resp.serialized.serialized_tx.bytes[0] = 0;
-		resp.serialized.serialized_tx.size = 1;
+		out[0] = 0;
+		resp.serialized.serialized_tx.size += 1;
 	}
 	//  if last witness add tx footer
 	if (idx1 == inputs_count - 1) {
@@ -785,8 +1057,88 @@ static bool signing_sign_segwit_input(TxInputType *txinput) {
 	return true;
 }
 
+/*
+ * Check the prevout and script type of a Phase 3 input against the
+ * checksum computed in Phase 1 (compared once the last witness is done).
+ */
+static void signing_hash_witness_input(const TxInputType *txinput) {
+	if (idx1 == 0) {
+		hasher_Reset(&hashers[2]);
+	}
+	tx_prevout_hash(&hashers[2], txinput);
+	hasher_Update(&hashers[2], (const uint8_t *) &txinput->script_type, sizeof(txinput->script_type));
+}
+
+static bool signing_parse_witness_input(const uint8_t **data, const uint8_t *end, TxInputType *txinput) {
+	const uint8_t *p = *data;
+	if (end - p < WITNESS_INPUT_HEADER_SIZE) {
+		return false;
+	}
+	memset(txinput, 0, sizeof(TxInputType));
+	txinput->prev_hash.size = 32;
+	memcpy(txinput->prev_hash.bytes, p, 32); p += 32;
+	memcpy(&txinput->prev_index, p, 4); p += 4;
+	txinput->has_sequence = true;
+	memcpy(&txinput->sequence, p, 4); p += 4;
+	txinput->has_amount = true;
+	memcpy(&txinput->amount, p, 8); p += 8;
+	txinput->has_script_type = true;
+	txinput->script_type = *p++;
+	txinput->address_n_count = *p++;
+	if (txinput->address_n_count > sizeof(txinput->address_n) / sizeof(txinput->address_n[0])
+		|| end - p < 4 * (int) txinput->address_n_count) {
+		return false;
+	}
+	memcpy(txinput->address_n, p, 4 * txinput->address_n_count); p += 4 * txinput->address_n_count;
+	*data = p;
+	return true;
+}
+
+/*
+ * Sign the inputs idx1, idx1 + 1, ... sent as compact witness inputs in
+ * one TxAck and return all their witnesses in one TxRequest.  Multisig
+ * inputs need the full TxInputType and are sent one by one.
+ */
+static bool signing_sign_segwit_batch(const uint8_t *data, uint32_t len) {
+	const uint8_t *end = data + len;
+	resp.has_serialized = true;
+	resp.serialized.has_serialized_tx = true;
+	for (;;) {
+		if (!signing_parse_witness_input(&data, end, &input)) {
+			fsm_sendFailure(FailureType_Failure_DataError, _("Invalid witness input"));
+			signing_abort();
+			return false;
+		}
+		if (resp.serialized.serialized_tx.size + WITNESS_MAX_SIZE + TXSIZE_FOOTER > sizeof(resp.serialized.serialized_tx.bytes)) {
+			fsm_sendFailure(FailureType_Failure_DataError, _("Too many witness inputs"));
+			signing_abort();
+			return false;
+		}
+		signing_hash_witness_input(&input);
+		if (!signing_sign_segwit_input(&input)) {
+			return false;
+		}
+		signatures++;
+		if (data == end) {
+			break;
+		}
+		if (idx1 >= inputs_count - 1) {
+			fsm_sendFailure(FailureType_Failure_DataError, _("Too many witness inputs"));
+			signing_abort();
+			return false;
+		}
+		idx1++;
+	}
+	// the signatures are only returned in the serialized witnesses
+	resp.serialized.has_signature_index = false;
+	resp.serialized.has_signature = false;
+	return true;
+}
+
 #define ENABLE_SEGWIT_NONSEGWIT_MIXING  1
 
+static void signing_txack_stage(TransactionType *tx);
+
 void signing_txack(TransactionType *tx)
 {
 	if (!signing) {
@@ -795,6 +1147,19 @@ void signing_txack(TransactionType *tx)
 		return;
 	}
 
+	uint32_t start = timer_ms();
+	int stage = signing_stage;
+	signing_stats.host_ms[stage] += start - stats_request_ms;
+	signing_stats.messages[stage]++;
+
+	signing_txack_stage(tx);
+
+	stats_request_ms = timer_ms();
+	signing_stats.compute_ms[stage] += stats_request_ms - start;
+}
+
+static void signing_txack_stage(TransactionType *tx)
+{
 	static int update_ctr = 0;
 	if (update_ctr++ == 20) {
 		layoutProgress(_("Signing transaction"), progress);
@@ -883,6 +1248,12 @@ void signing_txack(TransactionType *tx)
 			return;
 		case STAGE_REQUEST_2_PREV_META:
 			tx_init(&tp, tx->inputs_cnt, tx->outputs_cnt, tx->version, tx->lock_time, tx->extra_data_len, coin->curve->hasher_type);
+			if (tx->has_raw_size && tx->raw_size > 0) {
+				// host streams the serialized prevtx, parse it on the fly
+				tx_raw_init(&tp_raw, tx->raw_size, input.prev_index);
+				send_req_2_prev_raw(0, MIN(sizeof(tx->extra_data.bytes), tp_raw.raw_size));
+				return;
+			}
 			progress_meta_step = progress_step / (tp.inputs_len + tp.outputs_len);
 			idx2 = 0;
 			if (tp.inputs_len > 0) {
@@ -946,11 +1317,36 @@ void signing_txack(TransactionType *tx)
 				signing_check_prevtx_hash();
 			}
 			return;
+		case STAGE_REQUEST_2_PREV_RAW:
+			progress = (idx1 * progress_step + (uint32_t)(((uint64_t)progress_step * tp_raw.received) / tp_raw.raw_size)) >> PROGRESS_PRECISION;
+			if (tx->extra_data.size != MIN(sizeof(tx->extra_data.bytes), tp_raw.raw_size - tp_raw.received)
+				|| !tx_raw_update(&tp_raw, &tp, tx->extra_data.bytes, tx->extra_data.size)) {
+				fsm_sendFailure(FailureType_Failure_DataError, _("Failed to parse previous transaction"));
+				signing_abort();
+				return;
+			}
+			if (tp_raw.received < tp_raw.raw_size) {
+				send_req_2_prev_raw(tp_raw.received, MIN(sizeof(tx->extra_data.bytes), tp_raw.raw_size - tp_raw.received));
+				return;
+			}
+			if (!tx_raw_finished(&tp_raw)) {
+				fsm_sendFailure(FailureType_Failure_DataError, _("Failed to parse previous transaction"));
+				signing_abort();
+				return;
+			}
+			if (to_spend + tp_raw.amount < to_spend) {
+				fsm_sendFailure(FailureType_Failure_DataError, _("Value overflow"));
+				signing_abort();
+				return;
+			}
+			to_spend += tp_raw.amount;
+			signing_check_prevtx_hash();
+			return;
 		case STAGE_REQUEST_3_OUTPUT:
 			if (!signing_check_output(&tx->outputs[0])) {
 				return;
 			}
-			tx_weight += tx_output_weight(coin, &tx->outputs[0]);
+			tx_weight += tx_output_weight(&bin_output);
 			phase1_request_next_output();
 			return;
 		case STAGE_REQUEST_4_INPUT:
@@ -961,7 +1357,7 @@ void signing_txack(TransactionType *tx)
 			}
 			// check prevouts and script type
 			tx_prevout_hash(&hashers[0], tx->inputs);
-			hasher_Update(&hashers[0], (const uint8_t *) &tx->inputs[0].script_type, sizeof(&tx->inputs[0].script_type));
+			hasher_Update(&hashers[0], (const uint8_t *) &tx->inputs[0].script_type, sizeof(tx->inputs[0].script_type));
 			if (idx2 == idx1) {
 				if (!compile_input_script_sig(&tx->inputs[0])) {
 					fsm_sendFailure(FailureType_Failure_ProcessError, _("Failed to compile input"));
@@ -1131,10 +1527,17 @@ void signing_txack(TransactionType *tx)
 			return;
 
 		case STAGE_REQUEST_SEGWIT_WITNESS:
-			if (!signing_sign_segwit_input(&tx->inputs[0])) {
-				return;
+			if (tx->inputs_count == 0 && tx->has_extra_data) {
+				if (!signing_sign_segwit_batch(tx->extra_data.bytes, tx->extra_data.size)) {
+					return;
+				}
+			} else {
+				signing_hash_witness_input(&tx->inputs[0]);
+				if (!signing_sign_segwit_input(&tx->inputs[0])) {
+					return;
+				}
+				signatures++;
 			}
-			signatures++;
 			progress = 500 + ((signatures * progress_step) >> PROGRESS_PRECISION);
 			layoutProgress(_("Signing transaction"), progress);
 			update_ctr = 0;
@@ -1142,6 +1545,13 @@ void signing_txack(TransactionType *tx)
 				idx1++;
 				send_req_segwit_witness();
 			} else {
+				uint8_t hash[32];
+				hasher_Final(&hashers[2], hash);
+				if (memcmp(hash, hash_check, 32) != 0) {
+					fsm_sendFailure(FailureType_Failure_DataError, _("Transaction has changed during signing"));
+					signing_abort();
+					return;
+				}
 				send_req_finished();
 				signing_abort();
 			}
@@ -1152,10 +1562,20 @@ void signing_txack(TransactionType *tx)
 	signing_abort();
 }
 
-void signing_abort(void)
+// stops signing, but keeps the checkpoint for a retried SignTx
+void signing_suspend(void)
 {
 	if (signing) {
+		signing_stats.total_ms = timer_ms() - stats_start_ms;
 		layoutHome();
 		signing = false;
+		checkpoint.suspended_ms = timer_ms();
 	}
 }
+
+void signing_abort(void)
+{
+	signing_suspend();
+	// also drops the checkpoint of a signing suspended earlier
+	signing_resume_clear();
+}
@@ -27,8 +27,32 @@
 #include "hasher.h"
 #include "types.pb.h"
 
-void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinInfo *_coin, const HDNode *_root, uint32_t _version, uint32_t _lock_time);
+/* Number of STAGE_REQUEST_* values in signing.c */
+#define SIGNING_STAGE_COUNT 12
+
+/* Where the time of the last signing session went, per request stage.
+ * host_ms is the time from sending a TxRequest until its TxAck arrived,
+ * compute_ms the time the device spent handling that TxAck.
+ * confirm_ms and sign_ms are part of compute_ms. */
+typedef struct {
+	uint32_t messages[SIGNING_STAGE_COUNT];
+	uint32_t compute_ms[SIGNING_STAGE_COUNT];
+	uint32_t host_ms[SIGNING_STAGE_COUNT];
+	uint32_t confirm_ms;
+	uint32_t sign_ms;
+	uint32_t signatures;
+	uint32_t total_ms;
+} SigningStats;
+
+extern SigningStats signing_stats;
+
+/* Size of the token that identifies an interrupted signing session */
+#define SIGNING_RESUME_TOKEN_SIZE 16
+
+void signing_init(uint32_t _inputs_count, uint32_t _outputs_count, const CoinInfo *_coin, const HDNode *_root, uint32_t _version, uint32_t _lock_time, const uint8_t *resume_token);
+void signing_suspend(void);
 void signing_abort(void);
+void signing_resume_clear(void);
 void signing_txack(TransactionType *tx);
 
 #endif
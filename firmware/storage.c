@@ -39,6 +39,7 @@
 #include "debug.h"
 #include "protect.h"
 #include "layout2.h"
+#include "oled.h"
 #include "usb.h"
 #include "gettext.h"
 #include "u2f.h"
@@ -83,7 +84,8 @@ char storage_uuid_str[25];
 --------+--------------+-------------------------------
  0x4000 |     4 kbytes |  area for pin failures
  0x5000 |   256 bytes  |  area for u2f counter updates
- 0x5100 | 11.75 kbytes |  reserved
+ 0x5100 |     1 kbyte  |  area for spending policy records
+ 0x5500 | 10.75 kbytes |  reserved
 
 The area for pin failures looks like this:
 0 ... 0 pinfail 0xffffffff .. 0xffffffff
@@ -97,12 +99,18 @@ followed by a sequence of one-bits.  The bits in a byte are numbered
 from LSB to MSB.  The number of zero bits is the offset that should
 be added to the storage u2f_counter to get the real counter value.
 
+The area for spending policy records is a sequence of 64-bit amounts
+(low word first) followed by erased words.  Their sum is added to the
+storage policy_spent to get the amount spent under the current policy.
+
  */
 
 #define FLASH_STORAGE_PINAREA     (FLASH_META_START + 0x4000)
 #define FLASH_STORAGE_PINAREA_LEN (0x1000)
 #define FLASH_STORAGE_U2FAREA     (FLASH_STORAGE_PINAREA + FLASH_STORAGE_PINAREA_LEN)
 #define FLASH_STORAGE_U2FAREA_LEN (0x100)
+#define FLASH_STORAGE_POLICYAREA  (FLASH_STORAGE_U2FAREA + FLASH_STORAGE_U2FAREA_LEN)
+#define FLASH_STORAGE_POLICYAREA_LEN (0x400)
 #define FLASH_STORAGE_REALLEN     (sizeof(storage_magic) + sizeof(storage_uuid) + sizeof(Storage))
 
 #if !EMULATOR
@@ -116,16 +124,29 @@ _Static_assert(FLASH_STORAGE_START + FLASH_STORAGE_REALLEN <= FLASH_STORAGE_PINA
  */
 static uint32_t storage_u2f_offset;
 
+/* Number of records in the POLICYAREA and their sum, i.e. the amount
+ * spent under the policy is storage.policy_spent + storage_policy_offset.
+ */
+static uint32_t storage_policy_records;
+static uint64_t storage_policy_offset;
+
 static bool sessionSeedCached, sessionSeedUsesPassphrase;
 
 static uint8_t CONFIDENTIAL sessionSeed[64];
 
+/* Nesting depth of storage_begin/storage_end and the workflow that opened
+ * the outermost transaction.  While the depth is non-zero, storage_update
+ * only stages the changes in storageUpdate.
+ */
+static uint32_t storage_transaction_depth;
+static uint32_t storage_transaction_owner;
+
 static bool sessionPinCached;
 
 static bool sessionPassphraseCached;
 static char CONFIDENTIAL sessionPassphrase[51];
 
-#define STORAGE_VERSION 9
+#define STORAGE_VERSION 10
 
 void storage_show_error(void)
 {
@@ -161,6 +182,7 @@ bool storage_from_flash(void)
 	// version 7: since 1.5.1
 	// version 8: since 1.5.2
 	// version 9: since 1.6.1
+	// version 10: since 1.6.2
 	if (version > STORAGE_VERSION) {
 		// downgrade -> clear storage
 		return false;
@@ -190,6 +212,9 @@ bool storage_from_flash(void)
 	} else if (version <= 9) {
 		// added u2froot
 		old_storage_size = OLD_STORAGE_SIZE(u2froot);
+	} else if (version <= 10) {
+		// added policy, policy_spent and coin_definitions
+		old_storage_size = OLD_STORAGE_SIZE(coin_definitions);
 	}
 
 	// erase newly added fields
@@ -234,6 +259,15 @@ bool storage_from_flash(void)
 		storage_u2f_offset++;
 		u2fword >>= 1;
 	}
+	const uint32_t *policyptr = (const uint32_t *) FLASH_STORAGE_POLICYAREA;
+	storage_policy_records = 0;
+	storage_policy_offset = 0;
+	while (storage_policy_records < FLASH_STORAGE_POLICYAREA_LEN / sizeof(uint64_t)
+		&& (policyptr[0] != 0xffffffff || policyptr[1] != 0xffffffff)) {
+		storage_policy_offset += ((uint64_t) policyptr[1] << 32) | policyptr[0];
+		storage_policy_records++;
+		policyptr += 2;
+	}
 	// force recomputing u2f root for storage version < 9.
 	// this is done by re-setting the mnemonic, which triggers the computation
 	if (version < 9) {
@@ -353,8 +387,14 @@ static void storage_commit_locked(bool update)
 			storageUpdate.imported = storageRom->imported;
 		}
 		if (!storageUpdate.has_homescreen) {
-			storageUpdate.has_homescreen = storageRom->has_homescreen;
-			memcpy(&storageUpdate.homescreen, &storageRom->homescreen, sizeof(storageUpdate.homescreen));
+			// only the used part of the homescreen is programmed
+			uint32_t size;
+			const uint8_t *homescreen = storage_getHomescreen(&size);
+			storageUpdate.has_homescreen = homescreen != NULL;
+			if (homescreen) {
+				memcpy(storageUpdate.homescreen.bytes, homescreen, size);
+				storageUpdate.homescreen.size = size;
+			}
 		} else if (storageUpdate.homescreen.size == 0) {
 			storageUpdate.has_homescreen = false;
 		}
@@ -370,6 +410,20 @@ static void storage_commit_locked(bool update)
 			storageUpdate.has_flags = storageRom->has_flags;
 			storageUpdate.flags = storageRom->flags;
 		}
+		if (!storageUpdate.has_policy) {
+			storageUpdate.has_policy = storageRom->has_policy;
+			memcpy(&storageUpdate.policy, &storageRom->policy, sizeof(StoragePolicy));
+		} else if (!storageUpdate.policy.coin_name[0]) {
+			storageUpdate.has_policy = false;
+		}
+		if (!storageUpdate.has_policy_spent) {
+			storageUpdate.has_policy_spent = storageRom->has_policy_spent;
+			storageUpdate.policy_spent = storageRom->policy_spent;
+		}
+		if (!storageUpdate.has_coin_definitions) {
+			storageUpdate.has_coin_definitions = storageRom->has_coin_definitions;
+			memcpy(&storageUpdate.coin_definitions, &storageRom->coin_definitions, sizeof(StorageCoinDefinitions));
+		}
 	}
 
 	// backup meta
@@ -388,7 +442,14 @@ static void storage_commit_locked(bool update)
 	flash = storage_flash_words(flash, storage_uuid, sizeof(storage_uuid) / sizeof(uint32_t));
 
 	if (update) {
-		flash = storage_flash_words(flash, (const uint32_t *)&storageUpdate, sizeof(storageUpdate) / sizeof(uint32_t));
+		// leave the unused tail of the homescreen erased
+		const uint32_t *src = (const uint32_t *)&storageUpdate;
+		const uint32_t hs_start = offsetof(Storage, homescreen.bytes) / sizeof(uint32_t);
+		const uint32_t hs_used = (storageUpdate.homescreen.size + 3) / sizeof(uint32_t);
+		const uint32_t hs_end = hs_start + sizeof(storageUpdate.homescreen.bytes) / sizeof(uint32_t);
+		flash = storage_flash_words(flash, src, hs_start + hs_used);
+		flash += (hs_end - hs_start - hs_used) * sizeof(uint32_t);
+		flash = storage_flash_words(flash, src + hs_end, sizeof(storageUpdate) / sizeof(uint32_t) - hs_end);
 	}
 	storage_clear_update();
 
@@ -406,6 +467,9 @@ void storage_clear_update(void)
 
 void storage_update(void)
 {
+	if (storage_transaction_depth > 0) {
+		return; // written by the outermost storage_end
+	}
 	flash_clear_status_flags();
 	flash_unlock();
 	storage_commit_locked(true);
@@ -413,6 +477,47 @@ void storage_update(void)
 	storage_check_flash_errors();
 }
 
+/* Groups the storage updates of a multi-step workflow (which may span
+ * several messages) into a single write of the storage sector.
+ * The PIN failure, u2f and policy counters are not part of it, they are
+ * always written at once.  Note that recycling their area rewrites the
+ * storage including the changes staged so far.
+ * Transactions only nest within the workflow that opened the outermost
+ * one (identified by the message type that started it).  A transaction
+ * of another workflow is refused and the caller fails that workflow with
+ * "Storage busy"; fsm_abortInterruptedWorkflow ends a pending reset or
+ * recovery before a message that could start one.
+ */
+bool storage_begin(uint32_t workflow)
+{
+	if (storage_transaction_depth > 0 && storage_transaction_owner != workflow) {
+		return false;
+	}
+	storage_transaction_owner = workflow;
+	storage_transaction_depth++;
+	return true;
+}
+
+void storage_end(void)
+{
+	if (storage_transaction_depth == 0) {
+		return;
+	}
+	storage_transaction_depth--;
+	storage_update();
+}
+
+// drops all changes staged since the outermost storage_begin
+void storage_abort(void)
+{
+	if (storage_transaction_depth == 0) {
+		return;
+	}
+	storage_transaction_depth = 0;
+	storage_clear_update();
+	session_clear(true);
+}
+
 static void storage_setNode(const HDNodeType *node) {
 	storageUpdate.node.depth = node->depth;
 	storageUpdate.node.fingerprint = node->fingerprint;
@@ -519,7 +624,19 @@ void storage_setHomescreen(const uint8_t *data, uint32_t size)
 {
 	storageUpdate.has_homescreen = true;
 	if (data && size == 1024) {
-		memcpy(storageUpdate.homescreen.bytes, data, size);
+		memset(storageUpdate.homescreen.bytes, 0, sizeof(storageUpdate.homescreen.bytes));
+		// store the screen run-length encoded in display layout if it is
+		// smaller, a size of 1024 always means a raw bitmap
+		BITMAP b;
+		b.width = OLED_WIDTH;
+		b.height = OLED_HEIGHT;
+		b.data = data;
+		int packed = oledPackBitmap(&b, storageUpdate.homescreen.bytes, size - 1);
+		if (packed > 0) {
+			size = packed;
+		} else {
+			memcpy(storageUpdate.homescreen.bytes, data, size);
+		}
 		storageUpdate.homescreen.size = size;
 	} else {
 		memset(storageUpdate.homescreen.bytes, 0, sizeof(storageUpdate.homescreen.bytes));
@@ -621,9 +738,13 @@ const char *storage_getLanguage(void)
 	return storageRom->has_language ? storageRom->language : 0;
 }
 
-const uint8_t *storage_getHomescreen(void)
+const uint8_t *storage_getHomescreen(uint32_t *size)
 {
-	return (storageRom->has_homescreen && storageRom->homescreen.size == 1024) ? storageRom->homescreen.bytes : 0;
+	if (!storageRom->has_homescreen || storageRom->homescreen.size == 0 || storageRom->homescreen.size > 1024) {
+		return 0;
+	}
+	*size = storageRom->homescreen.size;
+	return storageRom->homescreen.bytes;
 }
 
 void storage_setMnemonic(const char *mnemonic)
@@ -672,6 +793,7 @@ bool storage_containsPin(const char *pin)
 	/* The execution time of the following code only depends on the
 	 * (public) input.  This avoids timing attacks.
 	 */
+	CT_SECRET(storageRom->pin, sizeof(storageRom->pin));
 	char diff = 0;
 	uint32_t i = 0;
 	while (pin[i]) {
@@ -679,6 +801,8 @@ bool storage_containsPin(const char *pin)
 		i++;
 	}
 	diff |= storageRom->pin[i];
+	CT_PUBLIC(storageRom->pin, sizeof(storageRom->pin));
+	CT_PUBLIC(&diff, sizeof(diff));
 	return diff == 0;
 }
 
@@ -755,9 +879,11 @@ void storage_clearPinArea(void)
 	flash_lock();
 	storage_check_flash_errors();
 	storage_u2f_offset = 0;
+	storage_policy_records = 0;
+	storage_policy_offset = 0;
 }
 
-// called when u2f area or pin area overflows
+// called when u2f area, policy area or pin area overflows
 static void storage_area_recycle(uint32_t new_pinfails)
 {
 	// first clear storage marker.  In case of a failure below it is better
@@ -774,12 +900,23 @@ static void storage_area_recycle(uint32_t new_pinfails)
 		storage_show_error();
 	}
 
+	// fold the erased counters into the storage and rewrite it,
+	// which also restores the storage marker
 	if (storage_u2f_offset > 0) {
-		storageUpdate.has_u2f_counter = true;
+		if (!storageUpdate.has_u2f_counter) {
+			storageUpdate.has_u2f_counter = true;
+			storageUpdate.u2f_counter = storageRom->u2f_counter;
+		}
 		storageUpdate.u2f_counter += storage_u2f_offset;
 		storage_u2f_offset = 0;
-		storage_commit_locked(true);
 	}
+	if (storage_policy_offset > 0 && !storageUpdate.has_policy_spent) {
+		storageUpdate.has_policy_spent = true;
+		storageUpdate.policy_spent = storageRom->policy_spent + storage_policy_offset;
+	}
+	storage_policy_records = 0;
+	storage_policy_offset = 0;
+	storage_commit_locked(true);
 }
 
 void storage_resetPinFails(uint32_t *pinfailsptr)
@@ -864,6 +1001,63 @@ uint32_t storage_getFlags(void)
 	return storageRom->has_flags ? storageRom->flags : 0;
 }
 
+const StoragePolicy *storage_getPolicy(void)
+{
+	return storageRom->has_policy ? &storageRom->policy : NULL;
+}
+
+// replaces the policy and restarts its spent amount from zero
+void storage_setPolicy(const StoragePolicy *policy)
+{
+	storageUpdate.has_policy = true;
+	if (policy) {
+		memcpy(&storageUpdate.policy, policy, sizeof(StoragePolicy));
+	} else {
+		memzero(&storageUpdate.policy, sizeof(StoragePolicy));
+	}
+	storageUpdate.has_policy_spent = true;
+	storageUpdate.policy_spent = 0;
+
+	// the old records have to go as well
+	flash_clear_status_flags();
+	flash_unlock();
+	storage_area_recycle(*storage_getPinFailsPtr());
+	flash_lock();
+	storage_check_flash_errors();
+}
+
+const StorageCoinDefinitions *storage_getCoinDefinitions(void)
+{
+	return storageRom->has_coin_definitions ? &storageRom->coin_definitions : NULL;
+}
+
+void storage_setCoinDefinitions(const StorageCoinDefinitions *defs)
+{
+	storageUpdate.has_coin_definitions = true;
+	memcpy(&storageUpdate.coin_definitions, defs, sizeof(StorageCoinDefinitions));
+}
+
+uint64_t storage_getPolicySpent(void)
+{
+	return (storageRom->has_policy_spent ? storageRom->policy_spent : 0) + storage_policy_offset;
+}
+
+void storage_addPolicySpent(uint64_t amount)
+{
+	flash_clear_status_flags();
+	flash_unlock();
+	if (storage_policy_records >= FLASH_STORAGE_POLICYAREA_LEN / sizeof(uint64_t)) {
+		storage_area_recycle(*storage_getPinFailsPtr());
+	}
+	uint32_t ptr = FLASH_STORAGE_POLICYAREA + storage_policy_records * sizeof(uint64_t);
+	flash_program_word(ptr, (uint32_t) amount);
+	flash_program_word(ptr + sizeof(uint32_t), (uint32_t) (amount >> 32));
+	storage_policy_records++;
+	storage_policy_offset += amount;
+	flash_lock();
+	storage_check_flash_errors();
+}
+
 uint32_t storage_nextU2FCounter(void)
 {
 	uint32_t *ptr = ((uint32_t *) FLASH_STORAGE_U2FAREA) + (storage_u2f_offset / 32);
@@ -889,6 +1083,7 @@ void storage_setU2FCounter(uint32_t u2fcounter)
 
 void storage_wipe(void)
 {
+	storage_transaction_depth = 0;
 	session_clear(true);
 	storage_generate_uuid();
 
@@ -56,6 +56,54 @@ typedef struct {
     STORAGE_BYTES(public_key,  33);
 } StorageHDNode;
 
+#define STORAGE_POLICY_DESTINATIONS 4
+
+typedef struct {
+    uint8_t chain_code[32];
+    uint8_t public_key[33];
+} StoragePolicyNode;
+
+typedef struct {
+    char coin_name[17];
+    uint32_t script_types;          // bitmask of allowed InputScriptType
+    uint32_t destinations_count;
+    StoragePolicyNode destinations[STORAGE_POLICY_DESTINATIONS];
+    uint64_t max_amount;            // per transaction, fee included
+    uint64_t total_amount;          // until the policy is applied again
+    uint64_t max_fee_per_kb;
+} StoragePolicy;
+
+#define STORAGE_COIN_DEFINITIONS 8
+
+#define COIN_DEFINITION_ADDRESS_TYPE      0x01
+#define COIN_DEFINITION_ADDRESS_TYPE_P2SH 0x02
+#define COIN_DEFINITION_SEGWIT            0x04
+#define COIN_DEFINITION_FORKID            0x08
+#define COIN_DEFINITION_FORCE_BIP143      0x10
+
+// one record of a coin definition table, as signed and sent by the host
+// (little-endian, strings NUL-terminated)
+typedef struct {
+    uint64_t maxfee_kb;
+    uint32_t address_type;
+    uint32_t address_type_p2sh;
+    uint32_t xpub_magic;
+    uint32_t xprv_magic;
+    uint32_t forkid;
+    uint32_t coin_type;
+    uint32_t flags;                 // COIN_DEFINITION_*
+    char coin_name[17];
+    char coin_shortcut[10];         // with a leading space, as in coins[]
+    char signed_message_header[32]; // with a leading length byte
+    char bech32_prefix[17];
+} StorageCoinDefinition;
+
+typedef struct {
+    uint32_t version;
+    uint32_t count;
+    StorageCoinDefinition coins[STORAGE_COIN_DEFINITIONS]; // sorted by coin_name
+} StorageCoinDefinitions;
+
 typedef struct _Storage {
     uint32_t version;
 
@@ -72,6 +120,9 @@ typedef struct _Storage {
     STORAGE_BOOL   (needs_backup)
     STORAGE_UINT32 (flags)
     STORAGE_NODE   (u2froot)
+    STORAGE_FIELD  (StoragePolicy, policy)
+    STORAGE_FIELD  (uint64_t, policy_spent)
+    STORAGE_FIELD  (StorageCoinDefinitions, coin_definitions)
 } Storage;
 
 extern Storage storageUpdate;
@@ -80,6 +131,9 @@ void storage_init(void);
 void storage_generate_uuid(void);
 void storage_clear_update(void);
 void storage_update(void);
+bool storage_begin(uint32_t workflow);
+void storage_end(void);
+void storage_abort(void);
 void session_clear(bool clear_pin);
 
 void storage_loadDevice(LoadDevice *msg);
@@ -98,7 +152,7 @@ void storage_setLanguage(const char *lang);
 void storage_setPassphraseProtection(bool passphrase_protection);
 bool storage_hasPassphraseProtection(void);
 
-const uint8_t *storage_getHomescreen(void);
+const uint8_t *storage_getHomescreen(uint32_t *size);
 void storage_setHomescreen(const uint8_t *data, uint32_t size);
 
 void session_cachePassphrase(const char *passphrase);
@@ -126,6 +180,14 @@ void storage_resetPinFails(uint32_t *pinfailptr);
 bool storage_increasePinFails(uint32_t *pinfailptr);
 uint32_t *storage_getPinFailsPtr(void);
 
+const StoragePolicy *storage_getPolicy(void);
+void storage_setPolicy(const StoragePolicy *policy);
+uint64_t storage_getPolicySpent(void);
+void storage_addPolicySpent(uint64_t amount);
+
+const StorageCoinDefinitions *storage_getCoinDefinitions(void);
+void storage_setCoinDefinitions(const StorageCoinDefinitions *defs);
+
 uint32_t storage_nextU2FCounter(void);
 void storage_setU2FCounter(uint32_t u2fcounter);
 
@@ -49,10 +49,6 @@
 #define TXSIZE_WITNESSPKHASH 22
 /* size of a p2wsh script (1 version, 1 push, 32 hash) */
 #define TXSIZE_WITNESSSCRIPT 34
-/* size of a p2pkh script (dup, hash, push, 20 pubkeyhash, equal, checksig) */
-#define TXSIZE_P2PKHASH 25
-/* size of a p2sh script (hash, push, 20 scripthash, equal) */
-#define TXSIZE_P2SCRIPT 23
 
 static const uint8_t segwit_header[2] = {0,1};
 
@@ -597,6 +593,205 @@ void tx_hash_final(TxStruct *t, uint8_t *hash, bool reverse)
 	}
 }
 
+enum {
+	TXRAW_VERSION,
+	TXRAW_INPUTS_COUNT,
+	TXRAW_INPUT_PREVOUT,
+	TXRAW_INPUT_SCRIPT_LEN,
+	TXRAW_INPUT_SCRIPT,
+	TXRAW_INPUT_SEQUENCE,
+	TXRAW_OUTPUTS_COUNT,
+	TXRAW_OUTPUT_AMOUNT,
+	TXRAW_OUTPUT_SCRIPT_LEN,
+	TXRAW_OUTPUT_SCRIPT,
+	TXRAW_LOCK_TIME,
+	TXRAW_EXTRA_DATA,
+	TXRAW_DONE,
+};
+
+static void tx_raw_skip(TxRawStream *raw, uint8_t state, uint32_t len)
+{
+	raw->state = state;
+	raw->remaining = len;
+}
+
+static void tx_raw_read(TxRawStream *raw, uint8_t state, uint8_t len)
+{
+	raw->state = state;
+	raw->field_len = 0;
+	raw->field_need = len;
+}
+
+static bool tx_raw_is_varint(uint8_t state)
+{
+	return state == TXRAW_INPUTS_COUNT || state == TXRAW_INPUT_SCRIPT_LEN
+		|| state == TXRAW_OUTPUTS_COUNT || state == TXRAW_OUTPUT_SCRIPT_LEN;
+}
+
+static bool tx_raw_is_skip(uint8_t state)
+{
+	return !tx_raw_is_varint(state) && state != TXRAW_OUTPUT_AMOUNT;
+}
+
+static uint64_t tx_raw_le(const uint8_t *data, uint8_t len)
+{
+	uint64_t r = 0;
+	for (int i = len - 1; i >= 0; i--) {
+		r = (r << 8) | data[i];
+	}
+	return r;
+}
+
+static uint64_t tx_raw_varint(const TxRawStream *raw)
+{
+	if (raw->field[0] < 0xFD) {
+		return raw->field[0];
+	}
+	return tx_raw_le(raw->field + 1, raw->field_len - 1);
+}
+
+// called when the current field is complete, selects the next one
+static bool tx_raw_next(TxRawStream *raw, const TxStruct *tx)
+{
+	uint64_t v;
+	switch (raw->state) {
+		case TXRAW_VERSION:
+			tx_raw_read(raw, TXRAW_INPUTS_COUNT, 1);
+			return true;
+		case TXRAW_INPUTS_COUNT:
+			v = tx_raw_varint(raw);
+			// zero inputs is the segwit marker, the txid does not cover witnesses
+			if (v == 0 || v > raw->raw_size) {
+				return false;
+			}
+			raw->count = v;
+			tx_raw_skip(raw, TXRAW_INPUT_PREVOUT, 36);
+			return true;
+		case TXRAW_INPUT_PREVOUT:
+			tx_raw_read(raw, TXRAW_INPUT_SCRIPT_LEN, 1);
+			return true;
+		case TXRAW_INPUT_SCRIPT_LEN:
+			v = tx_raw_varint(raw);
+			if (v > raw->raw_size) {
+				return false;
+			}
+			tx_raw_skip(raw, TXRAW_INPUT_SCRIPT, v);
+			return true;
+		case TXRAW_INPUT_SCRIPT:
+			tx_raw_skip(raw, TXRAW_INPUT_SEQUENCE, 4);
+			return true;
+		case TXRAW_INPUT_SEQUENCE:
+			raw->count--;
+			if (raw->count > 0) {
+				tx_raw_skip(raw, TXRAW_INPUT_PREVOUT, 36);
+			} else {
+				tx_raw_read(raw, TXRAW_OUTPUTS_COUNT, 1);
+			}
+			return true;
+		case TXRAW_OUTPUTS_COUNT:
+			v = tx_raw_varint(raw);
+			if (v > raw->raw_size) {
+				return false;
+			}
+			raw->count = v;
+			raw->output_index = 0;
+			if (raw->count > 0) {
+				tx_raw_read(raw, TXRAW_OUTPUT_AMOUNT, 8);
+			} else {
+				tx_raw_skip(raw, TXRAW_LOCK_TIME, 4);
+			}
+			return true;
+		case TXRAW_OUTPUT_AMOUNT:
+			if (raw->output_index == raw->prev_index) {
+				raw->amount = tx_raw_le(raw->field, 8);
+				raw->has_amount = true;
+			}
+			tx_raw_read(raw, TXRAW_OUTPUT_SCRIPT_LEN, 1);
+			return true;
+		case TXRAW_OUTPUT_SCRIPT_LEN:
+			v = tx_raw_varint(raw);
+			if (v > raw->raw_size) {
+				return false;
+			}
+			tx_raw_skip(raw, TXRAW_OUTPUT_SCRIPT, v);
+			return true;
+		case TXRAW_OUTPUT_SCRIPT:
+			raw->output_index++;
+			raw->count--;
+			if (raw->count > 0) {
+				tx_raw_read(raw, TXRAW_OUTPUT_AMOUNT, 8);
+			} else {
+				tx_raw_skip(raw, TXRAW_LOCK_TIME, 4);
+			}
+			return true;
+		case TXRAW_LOCK_TIME:
+			tx_raw_skip(raw, TXRAW_EXTRA_DATA, tx->extra_data_len);
+			return true;
+		case TXRAW_EXTRA_DATA:
+			raw->state = TXRAW_DONE;
+			return true;
+	}
+	return false;
+}
+
+void tx_raw_init(TxRawStream *raw, uint32_t raw_size, uint32_t prev_index)
+{
+	memset(raw, 0, sizeof(TxRawStream));
+	raw->raw_size = raw_size;
+	raw->prev_index = prev_index;
+	tx_raw_skip(raw, TXRAW_VERSION, 4);
+}
+
+bool tx_raw_update(TxRawStream *raw, TxStruct *tx, const uint8_t *data, uint32_t datalen)
+{
+	if (datalen > raw->raw_size - raw->received) {
+		// we are receiving too much data
+		return false;
+	}
+	hasher_Update(&(tx->hasher), data, datalen);
+	raw->received += datalen;
+	tx->size += datalen;
+
+	for (;;) {
+		if (raw->state == TXRAW_DONE) {
+			// trailing garbage after extra data
+			return datalen == 0;
+		}
+		if (tx_raw_is_skip(raw->state)) {
+			if (raw->remaining == 0) {
+				if (!tx_raw_next(raw, tx)) return false;
+				continue;
+			}
+			if (datalen == 0) break;
+			uint32_t n = raw->remaining < datalen ? raw->remaining : datalen;
+			data += n;
+			datalen -= n;
+			raw->remaining -= n;
+		} else {
+			if (datalen == 0) break;
+			raw->field[raw->field_len++] = *data;
+			data++;
+			datalen--;
+			if (tx_raw_is_varint(raw->state) && raw->field_len == 1) {
+				switch (raw->field[0]) {
+					case 0xFD: raw->field_need += 2; break;
+					case 0xFE: raw->field_need += 4; break;
+					case 0xFF: raw->field_need += 8; break;
+				}
+			}
+			if (raw->field_len == raw->field_need) {
+				if (!tx_raw_next(raw, tx)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool tx_raw_finished(const TxRawStream *raw)
+{
+	return raw->state == TXRAW_DONE && raw->received == raw->raw_size && raw->has_amount;
+}
+
 uint32_t tx_input_weight(const TxInputType *txinput) {
 	uint32_t input_script_size;
 	if (txinput->has_multisig) {
@@ -626,39 +821,9 @@ uint32_t tx_input_weight(const TxInputType *txinput) {
 	return weight;
 }
 
-uint32_t tx_output_weight(const CoinInfo *coin, const TxOutputType *txoutput) {
-	uint32_t output_script_size = 0;
-	if (txoutput->script_type == OutputScriptType_PAYTOOPRETURN) {
-		output_script_size = 1 + op_push_size(txoutput->op_return_data.size)
-			+ txoutput->op_return_data.size;
-	} else if (txoutput->address_n_count > 0) {
-		if (txoutput->script_type == OutputScriptType_PAYTOWITNESS) {
-			output_script_size = txoutput->has_multisig
-				? TXSIZE_WITNESSSCRIPT : TXSIZE_WITNESSPKHASH;
-		} else if (txoutput->script_type == OutputScriptType_PAYTOP2SHWITNESS) {
-			output_script_size = TXSIZE_P2SCRIPT;
-		} else {
-			output_script_size = txoutput->has_multisig
-				? TXSIZE_P2SCRIPT : TXSIZE_P2PKHASH;
-		}
-	} else {
-		uint8_t addr_raw[MAX_ADDR_RAW_SIZE];
-		int witver;
-		size_t addr_raw_len;
-		if (coin->bech32_prefix
-			&& segwit_addr_decode(&witver, addr_raw, &addr_raw_len, coin->bech32_prefix, txoutput->address)) {
-			output_script_size = 2 + addr_raw_len;
-		} else {
-			addr_raw_len = base58_decode_check(txoutput->address, coin->curve->hasher_type, addr_raw, MAX_ADDR_RAW_SIZE);
-			if (coin->has_address_type
-				&& address_check_prefix(addr_raw, coin->address_type)) {
-				output_script_size = TXSIZE_P2PKHASH;
-			} else if (coin->has_address_type_p2sh
-					   && address_check_prefix(addr_raw, coin->address_type_p2sh)) {
-				output_script_size = TXSIZE_P2SCRIPT;
-			}
-		} 
-	}
+// the output has to be compiled already, so the address is not decoded again
+uint32_t tx_output_weight(const TxOutputBinType *txoutput) {
+	uint32_t output_script_size = txoutput->script_pubkey.size;
 	output_script_size += ser_length_size(output_script_size);
 	return 4 * (TXSIZE_OUTPUT + output_script_size);
 }
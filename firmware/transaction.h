@@ -47,6 +47,26 @@ typedef struct {
 	Hasher hasher;
 } TxStruct;
 
+/* Incremental parser for a previous transaction streamed in its raw
+   (non-witness) serialization.  The bytes are fed into the hasher of the
+   TxStruct, the parser only keeps the amount of the output we spend. */
+typedef struct {
+	uint32_t raw_size;
+	uint32_t received;
+
+	uint8_t state;
+	uint8_t field[9];
+	uint8_t field_len;
+	uint8_t field_need;
+	uint32_t remaining;
+	uint32_t count;
+
+	uint32_t prev_index;
+	uint32_t output_index;
+	bool has_amount;
+	uint64_t amount;
+} TxRawStream;
+
 bool compute_address(const CoinInfo *coin, InputScriptType script_type, const HDNode *node, bool has_multisig, const MultisigRedeemScriptType *multisig, char address[MAX_ADDR_SIZE]);
 uint32_t compile_script_sig(uint32_t address_type, const uint8_t *pubkeyhash, uint8_t *out);
 uint32_t compile_script_multisig(const MultisigRedeemScriptType *multisig, uint8_t *out);
@@ -72,7 +92,11 @@ uint32_t tx_serialize_output_hash(TxStruct *tx, const TxOutputBinType *output);
 uint32_t tx_serialize_extra_data_hash(TxStruct *tx, const uint8_t *data, uint32_t datalen);
 void tx_hash_final(TxStruct *t, uint8_t *hash, bool reverse);
 
+void tx_raw_init(TxRawStream *raw, uint32_t raw_size, uint32_t prev_index);
+bool tx_raw_update(TxRawStream *raw, TxStruct *tx, const uint8_t *data, uint32_t datalen);
+bool tx_raw_finished(const TxRawStream *raw);
+
 uint32_t tx_input_weight(const TxInputType *txinput);
-uint32_t tx_output_weight(const CoinInfo *coin, const TxOutputType *txoutput);
+uint32_t tx_output_weight(const TxOutputBinType *txoutput);
 
 #endif
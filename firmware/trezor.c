@@ -24,6 +24,7 @@
 #include "usb.h"
 #include "setup.h"
 #include "storage.h"
+#include "coins.h"
 #include "layout.h"
 #include "layout2.h"
 #include "rng.h"
@@ -31,6 +32,11 @@
 #include "buttons.h"
 #include "gettext.h"
 #include "fastflash.h"
+#include "messages.h"
+#include "signing.h"
+#if USE_ETHEREUM
+#include "ethereum.h"
+#endif
 
 /* Screen timeout */
 uint32_t system_millis_lock_start;
@@ -39,6 +45,11 @@ void check_lock_screen(void)
 {
 	buttonUpdate();
 
+#if USE_ETHEREUM
+	// drops a batch whose next transaction did not arrive in time
+	ethereum_signing_batch_pending();
+#endif
+
 	// wake from screensaver on any button
 	if (layoutLast == layoutScreensaver && (button.NoUp || button.YesUp)) {
 		layoutHome();
@@ -67,6 +78,10 @@ void check_lock_screen(void)
 		if (button.YesUp) {
 			// lock the screen
 			session_clear(true);
+			signing_resume_clear();
+#if USE_ETHEREUM
+			ethereum_signing_abort();
+#endif
 			layoutScreensaver();
 		} else {
 			// resume homescreen
@@ -79,6 +94,10 @@ void check_lock_screen(void)
 		if ((timer_ms() - system_millis_lock_start) >= 600000) {
 			// lock the screen
 			session_clear(true);
+			signing_resume_clear();
+#if USE_ETHEREUM
+			ethereum_signing_abort();
+#endif
 			layoutScreensaver();
 		}
 	}
@@ -118,10 +137,12 @@ int main(void)
 	oledRefresh();
 
 	storage_init();
+	coins_init();
 	layoutHome();
 	usbInit();
 	for (;;) {
 		usbPoll();
+		msg_queue_dispatch();
 		check_lock_screen();
 	}
 
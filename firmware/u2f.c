@@ -521,7 +521,14 @@ static const HDNode *validateKeyHandle(const uint8_t app_id[], const uint8_t key
 	hmac_sha256(node->private_key, sizeof(node->private_key),
 				keybase, sizeof(keybase), hmac);
 
-	if (memcmp(&key_handle[KEY_PATH_LEN], hmac, SHA256_DIGEST_LENGTH) != 0)
+	// constant time, the MAC must not be guessable byte by byte
+	CT_SECRET(hmac, sizeof(hmac));
+	uint8_t diff = 0;
+	for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+		diff |= key_handle[KEY_PATH_LEN + i] ^ hmac[i];
+	}
+	CT_PUBLIC(&diff, sizeof(diff));
+	if (diff != 0)
 		return NULL;
 
 	// Done!
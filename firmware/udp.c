@@ -18,23 +18,56 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "usb.h"
 
 #include "messages.h"
+#include "signing.h"
 #include "timer.h"
 
 static volatile char tiny = 0;
+static uint32_t tiny_start;
+
+UsbStats usb_stats;
+
+static void usbStatsDump(void) {
+	fprintf(stderr, "usb: in %u/%u/%u out %u/%u/%u spins %u polls %u idle %u tiny %u ms "
+		"resets %u out depth max %u avg %u\n",
+		(unsigned) usb_stats.packets_in[USB_STATS_MAIN], (unsigned) usb_stats.packets_in[USB_STATS_U2F], (unsigned) usb_stats.packets_in[USB_STATS_DEBUG],
+		(unsigned) usb_stats.packets_out[USB_STATS_MAIN], (unsigned) usb_stats.packets_out[USB_STATS_U2F], (unsigned) usb_stats.packets_out[USB_STATS_DEBUG],
+		(unsigned) usb_stats.write_spins, (unsigned) usb_stats.polls, (unsigned) usb_stats.idle_polls, (unsigned) usb_stats.tiny_ms,
+		(unsigned) usb_stats.reassembly_resets, (unsigned) usb_stats.out_depth_max,
+		(unsigned) (usb_stats.out_depth_samples ? usb_stats.out_depth_sum / usb_stats.out_depth_samples : 0));
+}
+
+// the last signing session, as one line of JSON
+static void signingStatsDump(void) {
+	fprintf(stderr, "{\"signing\": {\"total_ms\": %u, \"confirm_ms\": %u, \"sign_ms\": %u, \"signatures\": %u, \"stages\": [",
+		(unsigned) signing_stats.total_ms, (unsigned) signing_stats.confirm_ms,
+		(unsigned) signing_stats.sign_ms, (unsigned) signing_stats.signatures);
+	for (int i = 0; i < SIGNING_STAGE_COUNT; i++) {
+		fprintf(stderr, "%s{\"messages\": %u, \"compute_ms\": %u, \"host_ms\": %u}", i ? ", " : "",
+			(unsigned) signing_stats.messages[i], (unsigned) signing_stats.compute_ms[i], (unsigned) signing_stats.host_ms[i]);
+	}
+	fprintf(stderr, "]}}\n");
+}
 
 void usbInit(void) {
 	emulatorSocketInit();
+	atexit(usbStatsDump);
+	atexit(signingStatsDump);
 }
 
 void usbPoll(void) {
 	emulatorPoll();
 
+	uint32_t packets = usbStatsPackets();
+
 	static uint8_t buffer[64];
 	if (emulatorSocketRead(buffer, sizeof(buffer)) > 0) {
+		usb_stats.packets_in[USB_STATS_MAIN]++;
 		if (!tiny) {
 			msg_read(buffer, sizeof(buffer));
 		} else {
@@ -43,20 +76,33 @@ void usbPoll(void) {
 	}
 
 	const uint8_t *data = msg_out_data();
+	int iface = USB_STATS_MAIN;
 
 #if DEBUG_LINK
 	if (data == NULL) {
 		data = msg_debug_out_data();
+		iface = USB_STATS_DEBUG;
 	}
 #endif
 
 	if (data != NULL) {
 		emulatorSocketWrite(data, 64);
+		usb_stats.packets_out[iface]++;
+	}
+
+	usb_stats.polls++;
+	if (usbStatsPackets() == packets) {
+		usb_stats.idle_polls++;
 	}
 }
 
 char usbTiny(char set) {
 	char old = tiny;
+	if (set && !old) {
+		tiny_start = timer_ms();
+	} else if (!set && old) {
+		usb_stats.tiny_ms += timer_ms() - tiny_start;
+	}
 	tiny = set;
 	return old;
 }
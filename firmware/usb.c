@@ -271,12 +271,16 @@ static int hid_control_request(usbd_device *dev, struct usb_setup_data *req, uin
 }
 
 static volatile char tiny = 0;
+static uint32_t tiny_start;
+
+UsbStats usb_stats;
 
 static void main_rx_callback(usbd_device *dev, uint8_t ep)
 {
 	(void)ep;
 	static CONFIDENTIAL uint8_t buf[64] __attribute__ ((aligned(4)));
 	if ( usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_MAIN_OUT, buf, 64) != 64) return;
+	usb_stats.packets_in[USB_STATS_MAIN]++;
 	debugLog(0, "", "main_rx_callback");
 	if (!tiny) {
 		msg_read(buf, 64);
@@ -292,6 +296,7 @@ static void u2f_rx_callback(usbd_device *dev, uint8_t ep)
 
 	debugLog(0, "", "u2f_rx_callback");
 	if ( usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_U2F_OUT, buf, 64) != 64) return;
+	usb_stats.packets_in[USB_STATS_U2F]++;
 	u2fhid_read(tiny, (const U2FHID_FRAME *) (void*) buf);
 }
 
@@ -301,11 +306,12 @@ static void debug_rx_callback(usbd_device *dev, uint8_t ep)
 	(void)ep;
 	static CONFIDENTIAL uint8_t buf[64] __attribute__ ((aligned(4)));
 	if ( usbd_ep_read_packet(dev, ENDPOINT_ADDRESS_DEBUG_OUT, buf, 64) != 64) return;
+	usb_stats.packets_in[USB_STATS_DEBUG]++;
 	debugLog(0, "", "debug_rx_callback");
 	if (!tiny) {
 		msg_debug_read(buf, 64);
 	} else {
-		msg_read_tiny(buf, 64);
+		msg_debug_read_tiny(buf, 64);
 	}
 }
 #endif
@@ -356,27 +362,40 @@ void usbInit(void)
 	winusb_setup(usbd_dev, USB_INTERFACE_INDEX_MAIN);
 }
 
+static void usbWrite(uint8_t ep, const uint8_t *data, int iface)
+{
+	while ( usbd_ep_write_packet(usbd_dev, ep, data, 64) != 64 ) {
+		usb_stats.write_spins++;
+	}
+	usb_stats.packets_out[iface]++;
+}
+
 void usbPoll(void)
 {
 	static const uint8_t *data;
+	uint32_t packets = usbStatsPackets();
 	// poll read buffer
 	usbd_poll(usbd_dev);
 	// write pending data
 	data = msg_out_data();
 	if (data) {
-		while ( usbd_ep_write_packet(usbd_dev, ENDPOINT_ADDRESS_MAIN_IN, data, 64) != 64 ) {}
+		usbWrite(ENDPOINT_ADDRESS_MAIN_IN, data, USB_STATS_MAIN);
 	}
 	data = u2f_out_data();
 	if (data) {
-		while ( usbd_ep_write_packet(usbd_dev, ENDPOINT_ADDRESS_U2F_IN, data, 64) != 64 ) {}
+		usbWrite(ENDPOINT_ADDRESS_U2F_IN, data, USB_STATS_U2F);
 	}
 #if DEBUG_LINK
 	// write pending debug data
 	data = msg_debug_out_data();
 	if (data) {
-		while ( usbd_ep_write_packet(usbd_dev, ENDPOINT_ADDRESS_DEBUG_IN, data, 64) != 64 ) {}
+		usbWrite(ENDPOINT_ADDRESS_DEBUG_IN, data, USB_STATS_DEBUG);
 	}
 #endif
+	usb_stats.polls++;
+	if (usbStatsPackets() == packets) {
+		usb_stats.idle_polls++;
+	}
 }
 
 void usbReconnect(void)
@@ -389,6 +408,11 @@ void usbReconnect(void)
 char usbTiny(char set)
 {
 	char old = tiny;
+	if (set && !old) {
+		tiny_start = timer_ms();
+	} else if (!set && old) {
+		usb_stats.tiny_ms += timer_ms() - tiny_start;
+	}
 	tiny = set;
 	return old;
 }
@@ -20,6 +20,39 @@
 #ifndef __USB_H__
 #define __USB_H__
 
+#include <stdint.h>
+
+enum {
+	USB_STATS_MAIN,
+	USB_STATS_U2F,
+	USB_STATS_DEBUG,
+	USB_STATS_COUNT,
+};
+
+typedef struct {
+	uint32_t packets_in[USB_STATS_COUNT];
+	uint32_t packets_out[USB_STATS_COUNT];
+	uint32_t write_spins;        // failed usbd_ep_write_packet calls
+	uint32_t idle_polls;         // usbPoll calls without any traffic
+	uint32_t polls;
+	uint32_t tiny_ms;            // time spent in tiny mode
+	uint32_t reassembly_resets;  // bad continuation packets
+	uint32_t out_depth_max;      // msg_out queue depth in packets
+	uint32_t out_depth_sum;
+	uint32_t out_depth_samples;
+} UsbStats;
+
+extern UsbStats usb_stats;
+
+static inline uint32_t usbStatsPackets(void)
+{
+	uint32_t r = 0;
+	for (int i = 0; i < USB_STATS_COUNT; i++) {
+		r += usb_stats.packets_in[i] + usb_stats.packets_out[i];
+	}
+	return r;
+}
+
 void usbInit(void);
 void usbPoll(void);
 void usbReconnect(void);
@@ -102,6 +102,31 @@
 #define FLASH_CODE_SECTOR_FIRST	4
 #define FLASH_CODE_SECTOR_LAST	7
 
+/*
+ fastflash handoff mailbox:
+
+ When the firmware starts the RAM bootloader (fastflash) it leaves a
+ FastflashMailbox at the start of the bootloader's RAM, right after the
+ bootloader image.  The bootloader keeps that word range out of its own
+ RAM (see memory_app_fastflash.ld), consumes the mailbox once and clears it.
+ */
+
+#define FASTFLASH_RAM_START	(0x20000000 + 32 * 1024)
+#define FASTFLASH_MAILBOX_LEN	(0x40)
+
+#define FASTFLASH_MAILBOX_MAGIC	0x786f6266   // 'fbox' as uint32_t
+
+// the bootloader starts as if Initialize was received, so the host can
+// send FirmwareErase right away
+#define FASTFLASH_FLAG_OPEN	0x00000001
+
+typedef struct {
+	uint32_t magic;
+	uint32_t flags;
+} FastflashMailbox;
+
+#define FASTFLASH_MAILBOX	((volatile FastflashMailbox *) FASTFLASH_RAM_START)
+
 void memory_protect(void);
 int memory_bootloader_hash(uint8_t *hash);
 
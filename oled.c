@@ -325,6 +325,76 @@ void oledDrawBitmap(int x, int y, const BITMAP *bmp)
 	}
 }
 
+/*
+ * Converts a full screen bitmap into the display buffer layout and
+ * run-length encodes it: a control byte c < 0x80 is followed by c + 1
+ * literal bytes, c >= 0x80 repeats the following byte c - 0x80 + 2 times.
+ * Returns the encoded length or 0 if it does not fit into maxlen bytes.
+ */
+int oledPackBitmap(const BITMAP *bmp, uint8_t *out, int maxlen)
+{
+	uint8_t buf[OLED_BUFSIZE];
+	memset(buf, 0, sizeof(buf));
+	for (int i = 0; i < bmp->width && i < OLED_WIDTH; i++) {
+		for (int j = 0; j < bmp->height && j < OLED_HEIGHT; j++) {
+			if (bmp->data[(i / 8) + j * bmp->width / 8] & (1 << (7 - i % 8))) {
+				buf[OLED_OFFSET(i, j)] |= OLED_MASK(i, j);
+			}
+		}
+	}
+
+	int r = 0;
+	for (int pos = 0; pos < OLED_BUFSIZE; ) {
+		int run = 1;
+		while (pos + run < OLED_BUFSIZE && run < 129 && buf[pos + run] == buf[pos]) {
+			run++;
+		}
+		if (run >= 2) {
+			if (r + 2 > maxlen) return 0;
+			out[r++] = 0x80 + run - 2;
+			out[r++] = buf[pos];
+			pos += run;
+		} else {
+			// literal bytes up to the start of the next run
+			int lit = 1;
+			while (pos + lit < OLED_BUFSIZE && lit < 128
+				&& (pos + lit + 1 >= OLED_BUFSIZE || buf[pos + lit] != buf[pos + lit + 1])) {
+				lit++;
+			}
+			if (r + 1 + lit > maxlen) return 0;
+			out[r++] = lit - 1;
+			memcpy(out + r, buf + pos, lit);
+			r += lit;
+			pos += lit;
+		}
+	}
+	return r;
+}
+
+/*
+ * Fills the whole display buffer from data encoded by oledPackBitmap.
+ */
+void oledDrawPacked(const uint8_t *data, int len)
+{
+	int pos = 0;
+	for (int i = 0; i < len && pos < OLED_BUFSIZE; ) {
+		uint8_t c = data[i++];
+		if (c < 0x80) {
+			int n = c + 1;
+			if (n > len - i || n > OLED_BUFSIZE - pos) break;
+			memcpy(_oledbuffer + pos, data + i, n);
+			i += n;
+			pos += n;
+		} else {
+			int n = c - 0x80 + 2;
+			if (i >= len || n > OLED_BUFSIZE - pos) break;
+			memset(_oledbuffer + pos, data[i++], n);
+			pos += n;
+		}
+	}
+	memset(_oledbuffer + pos, 0, OLED_BUFSIZE - pos);
+}
+
 /*
  * Inverts box between (x1,y1) and (x2,y2) inclusive.
  */
@@ -49,6 +49,8 @@ void oledDrawString(int x, int y, const char* text, int font);
 void oledDrawStringCenter(int y, const char* text, int font);
 void oledDrawStringRight(int x, int y, const char* text, int font);
 void oledDrawBitmap(int x, int y, const BITMAP *bmp);
+int oledPackBitmap(const BITMAP *bmp, uint8_t *out, int maxlen);
+void oledDrawPacked(const uint8_t *data, int len);
 void oledInvert(int x1, int y1, int x2, int y2);
 void oledBox(int x1, int y1, int x2, int y2, bool set);
 void oledHLine(int y);
@@ -0,0 +1,107 @@
+# Spending policy (ApplyPolicy).  An output to a policy destination is not
+# shown while the policy may still cover the transaction.  When the
+# transaction turns out to be over the limits, the skipped outputs are
+# shown before the total.
+
+from binascii import unhexlify
+
+import pytest
+
+from trezorlib import messages as proto
+from trezorlib.client import CallException
+from trezorlib.tests.device_tests.common import TrezorTest
+
+H = 0x80000000
+DESTINATION = [44 | H, 0 | H, 0 | H, 0]
+
+
+class ButtonRecorder(object):
+    """Records the ButtonRequests and presses no on the one given."""
+
+    def __init__(self, client, reject=None):
+        self.client = client
+        self.reject = reject
+        self.codes = []
+
+    def __enter__(self):
+        self.call_raw = self.client.call_raw
+        self.client.call_raw = self.exchange
+        return self
+
+    def __exit__(self, *args):
+        del self.client.call_raw
+
+    def exchange(self, msg):
+        resp = self.call_raw(msg)
+        while isinstance(resp, proto.ButtonRequest):
+            self.codes.append(resp.code)
+            if resp.code == self.reject:
+                self.client.debug.press_no()
+            else:
+                self.client.debug.press_yes()
+            resp = self.call_raw(proto.ButtonAck())
+        return resp
+
+
+class TestPolicy(TrezorTest):
+
+    def apply_policy(self, max_amount):
+        node = self.client.get_public_node(DESTINATION).node
+        ret = self.client.call(proto.ApplyPolicy(coin_name='Bitcoin',
+                                                 destinations=[node],
+                                                 script_types=[proto.InputScriptType.SPENDADDRESS],
+                                                 max_amount=max_amount,
+                                                 total_amount=1000000,
+                                                 max_fee_per_kb=100000))
+        assert isinstance(ret, proto.Success)
+
+    def sign(self, reject=None):
+        # tx: d5f65ee80147b4bcc70b75e4bbf2d7382021b871bd8867ef8fa525ef50864882
+        # input 0: 0.0039 BTC
+        inp1 = proto.TxInputType(address_n=[0],  # 14LmW5k4ssUrtbAB4255zdqv3b4w1TuX9e
+                                 prev_hash=unhexlify('d5f65ee80147b4bcc70b75e4bbf2d7382021b871bd8867ef8fa525ef50864882'),
+                                 prev_index=0)
+        out1 = proto.TxOutputType(address=self.client.get_address('Bitcoin', DESTINATION + [5]),
+                                  amount=390000 - 10000,
+                                  script_type=proto.OutputScriptType.PAYTOADDRESS,
+                                  policy_index=0,
+                                  policy_path=[5])
+        with ButtonRecorder(self.client, reject) as recorder:
+            self.client.sign_tx('Bitcoin', [inp1, ], [out1, ])
+        return recorder.codes
+
+    def test_accept(self):
+        self.setup_mnemonic_nopin_nopassphrase()
+        self.apply_policy(400000)
+
+        assert self.sign() == []
+
+    def test_fallback(self):
+        self.setup_mnemonic_nopin_nopassphrase()
+        # the output is within the cap, the output plus the fee is not
+        self.apply_policy(385000)
+
+        assert self.sign() == [proto.ButtonRequestType.ConfirmOutput,
+                               proto.ButtonRequestType.SignTx]
+
+    def test_reject(self):
+        self.setup_mnemonic_nopin_nopassphrase()
+        self.apply_policy(385000)
+
+        with pytest.raises(CallException) as exc:
+            self.sign(reject=proto.ButtonRequestType.ConfirmOutput)
+        assert exc.value.args[0] == proto.FailureType.ActionCancelled
+
+    def test_unsupported_coin(self):
+        self.setup_mnemonic_nopin_nopassphrase()
+        node = self.client.get_public_node(DESTINATION).node
+
+        # Ethereum signing never consults the policy, so none can be applied
+        with pytest.raises(CallException) as exc:
+            self.client.call(proto.ApplyPolicy(coin_name='Ethereum',
+                                               destinations=[node],
+                                               script_types=[proto.InputScriptType.SPENDADDRESS],
+                                               max_amount=400000,
+                                               total_amount=1000000,
+                                               max_fee_per_kb=100000))
+        assert exc.value.args[0] == proto.FailureType.DataError
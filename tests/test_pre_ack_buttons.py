@@ -0,0 +1,128 @@
+# Round trips saved by pre_ack_buttons.  Every workflow is run twice, once
+# answering each ButtonRequest with a ButtonAck and once with the button
+# requests pre-acknowledged in its first message, where they arrive only
+# as notifications and must not be answered.
+
+from binascii import unhexlify
+
+from trezorlib import messages as proto
+from trezorlib.tests.device_tests.common import TrezorTest
+
+
+class ButtonCounter(object):
+    """Presses yes on every ButtonRequest and counts the round trips."""
+
+    def __init__(self, client, pre_ack):
+        self.client = client
+        self.pre_ack = pre_ack
+        self.requests = 0
+        self.acks = 0
+
+    def __enter__(self):
+        self.call_raw = self.client.call_raw
+        self.client.call_raw = self.exchange
+        return self
+
+    def __exit__(self, *args):
+        del self.client.call_raw
+
+    def exchange(self, msg):
+        if isinstance(msg, (proto.SignTx, proto.ResetDevice, proto.RecoveryDevice)):
+            msg.pre_ack_buttons = self.pre_ack
+        resp = self.call_raw(msg)
+        while isinstance(resp, proto.ButtonRequest):
+            self.requests += 1
+            self.client.debug.press_yes()
+            if self.pre_ack:
+                resp = self.client.transport.read()
+            else:
+                self.acks += 1
+                resp = self.call_raw(proto.ButtonAck())
+        return resp
+
+
+class TestPreAckButtons(TrezorTest):
+
+    def test_features(self):
+        features = self.client.call_raw(proto.GetFeatures())
+        assert features.pre_ack_buttons is True
+
+    def sign(self, pre_ack):
+        # tx: d5f65ee80147b4bcc70b75e4bbf2d7382021b871bd8867ef8fa525ef50864882
+        # input 0: 0.0039 BTC
+        inp1 = proto.TxInputType(address_n=[0],  # 14LmW5k4ssUrtbAB4255zdqv3b4w1TuX9e
+                                 prev_hash=unhexlify('d5f65ee80147b4bcc70b75e4bbf2d7382021b871bd8867ef8fa525ef50864882'),
+                                 prev_index=0)
+        out1 = proto.TxOutputType(address='1MJ2tj2ThBE62zXbBYA5ZaN3fdve5CPAz1',
+                                  amount=390000 - 10000,
+                                  script_type=proto.OutputScriptType.PAYTOADDRESS)
+        with ButtonCounter(self.client, pre_ack) as counter:
+            _, serialized_tx = self.client.sign_tx('Bitcoin', [inp1, ], [out1, ])
+        return counter, serialized_tx
+
+    def test_signtx(self):
+        self.setup_mnemonic_nopin_nopassphrase()
+
+        acked, serialized_acked = self.sign(False)
+        pre_acked, serialized_pre_acked = self.sign(True)
+
+        # confirm output, confirm transaction
+        assert acked.requests == 2
+        assert acked.acks == 2
+        assert pre_acked.requests == 2
+        assert pre_acked.acks == 0
+        assert serialized_pre_acked == serialized_acked
+
+    def reset(self, pre_ack):
+        with ButtonCounter(self.client, pre_ack) as counter:
+            ret = self.client.call_raw(proto.ResetDevice(display_random=True,
+                                                         strength=128,
+                                                         passphrase_protection=False,
+                                                         pin_protection=False,
+                                                         language='english',
+                                                         label='test'))
+            assert isinstance(ret, proto.EntropyRequest)
+            ret = self.client.call_raw(proto.EntropyAck(entropy=b'\x00' * 32))
+            assert isinstance(ret, proto.Success)
+        return counter
+
+    def test_resetdevice(self):
+        acked = self.reset(False)
+        self.client.wipe_device()
+        pre_acked = self.reset(True)
+
+        # internal entropy, then every one of the 12 words twice
+        assert acked.requests == 25
+        assert acked.acks == 25
+        assert pre_acked.requests == 25
+        assert pre_acked.acks == 0
+
+        features = self.client.call_raw(proto.Initialize())
+        assert features.initialized is True
+        assert features.needs_backup is False
+
+    def recover(self, pre_ack):
+        mnemonic = self.mnemonic12.split(' ')
+        with ButtonCounter(self.client, pre_ack) as counter:
+            ret = self.client.call_raw(proto.RecoveryDevice(word_count=12,
+                                                            enforce_wordlist=True,
+                                                            dry_run=True))
+            while isinstance(ret, proto.WordRequest):
+                (word, pos) = self.client.debug.read_recovery_word()
+                if pos != 0:
+                    word = mnemonic[pos - 1]
+                ret = self.client.call_raw(proto.WordAck(word=word))
+            assert isinstance(ret, proto.Success)
+        return counter
+
+    def test_recoverydevice(self):
+        self.setup_mnemonic_nopin_nopassphrase()
+
+        acked = self.recover(False)
+        pre_acked = self.recover(True)
+
+        # the seed is valid and matches
+        assert acked.requests == 1
+        assert acked.acks == 1
+        assert pre_acked.requests == 1
+        assert pre_acked.acks == 0
@@ -0,0 +1,216 @@
+# Storage transactions of ResetDevice and RecoveryDevice (storage_begin /
+# storage_end).  The emulator maps its flash to a file with MAP_SHARED, so
+# the file shows at any moment what a power loss at that moment would
+# leave behind.
+
+import os
+
+import pytest
+
+from trezorlib import messages as proto
+from trezorlib.tests.device_tests.common import TrezorTest
+
+FLASH_FILE = os.environ.get('TREZOR_EMULATOR_FLASH', 'emulator.img')
+
+
+def read_flash():
+    with open(FLASH_FILE, 'rb') as f:
+        return f.read()
+
+
+@pytest.mark.skipif(not os.path.exists(FLASH_FILE), reason='emulator only')
+class TestStorageTransaction(TrezorTest):
+
+    def start_reset(self):
+        ret = self.client.call_raw(proto.ResetDevice(display_random=False,
+                                                     strength=128,
+                                                     passphrase_protection=False,
+                                                     pin_protection=False,
+                                                     language='english',
+                                                     label='test'))
+        assert isinstance(ret, proto.EntropyRequest)
+
+    def finish_backup(self, ret, words=12):
+        # every word is shown twice
+        for _ in range(2 * words):
+            assert isinstance(ret, proto.ButtonRequest)
+            self.client.debug.press_yes()
+            ret = self.client.call_raw(proto.ButtonAck())
+        return ret
+
+    def start_recovery(self):
+        ret = self.client.call_raw(proto.RecoveryDevice(word_count=12,
+                                                        passphrase_protection=False,
+                                                        pin_protection=False,
+                                                        label='label',
+                                                        language='english',
+                                                        enforce_wordlist=True))
+        assert isinstance(ret, proto.WordRequest)
+        return ret
+
+    def enter_words(self, ret, mnemonic):
+        while isinstance(ret, proto.WordRequest):
+            (word, pos) = self.client.debug.read_recovery_word()
+            if pos != 0:
+                word = mnemonic[pos - 1]
+            ret = self.client.call_raw(proto.WordAck(word=word))
+        return ret
+
+    def test_reset_power_loss(self):
+        before = read_flash()
+        self.start_reset()
+        # power loss while waiting for the entropy
+        assert read_flash() == before
+
+        ret = self.client.call_raw(proto.EntropyAck(entropy=b'\x00' * 32))
+        for _ in range(12):
+            assert isinstance(ret, proto.ButtonRequest)
+            self.client.debug.press_yes()
+            ret = self.client.call_raw(proto.ButtonAck())
+        # power loss in the middle of the backup
+        assert read_flash() == before
+
+        ret = self.finish_backup(ret, words=6)
+        assert isinstance(ret, proto.Success)
+        assert read_flash() != before
+
+        features = self.client.call_raw(proto.Initialize())
+        assert features.initialized is True
+        assert features.needs_backup is False
+        assert features.label == 'test'
+
+    def test_reset_cancelled_backup(self):
+        before = read_flash()
+        self.start_reset()
+        ret = self.client.call_raw(proto.EntropyAck(entropy=b'\x00' * 32))
+        assert isinstance(ret, proto.ButtonRequest)
+        self.client.debug.press_no()
+        ret = self.client.call_raw(proto.ButtonAck())
+        assert isinstance(ret, proto.Failure)
+        assert ret.code == proto.FailureType.ActionCancelled
+        assert read_flash() == before
+
+        features = self.client.call_raw(proto.Initialize())
+        assert features.initialized is False
+
+    def test_reset_interrupted(self):
+        self.start_reset()
+
+        # a message that writes the storage ends the reset and is written
+        # at once
+        ret = self.client.call_raw(proto.ApplySettings(label='other'))
+        assert isinstance(ret, proto.ButtonRequest)
+        self.client.debug.press_yes()
+        ret = self.client.call_raw(proto.ButtonAck())
+        assert isinstance(ret, proto.Success)
+        after = read_flash()
+
+        ret = self.client.call_raw(proto.EntropyAck(entropy=b'\x00' * 32))
+        assert isinstance(ret, proto.Failure)
+        assert ret.code == proto.FailureType.UnexpectedMessage
+        assert read_flash() == after
+
+        features = self.client.call_raw(proto.GetFeatures())
+        assert features.initialized is False
+        assert features.label == 'other'
+
+    def test_reset_twice(self):
+        self.start_reset()
+        # the second reset replaces the first one instead of nesting in it
+        self.start_reset()
+
+        ret = self.client.call_raw(proto.EntropyAck(entropy=b'\x00' * 32))
+        ret = self.finish_backup(ret)
+        assert isinstance(ret, proto.Success)
+
+        features = self.client.call_raw(proto.Initialize())
+        assert features.initialized is True
+
+    def test_recovery_power_loss(self):
+        before = read_flash()
+        ret = self.start_recovery()
+        mnemonic = self.mnemonic12.split(' ')
+
+        for _ in range(12):
+            assert isinstance(ret, proto.WordRequest)
+            (word, pos) = self.client.debug.read_recovery_word()
+            if pos != 0:
+                word = mnemonic[pos - 1]
+            ret = self.client.call_raw(proto.WordAck(word=word))
+        # power loss after half of the words
+        assert read_flash() == before
+
+        ret = self.enter_words(ret, mnemonic)
+        assert isinstance(ret, proto.Success)
+        assert read_flash() != before
+
+        features = self.client.call_raw(proto.Initialize())
+        assert features.initialized is True
+        assert features.label == 'label'
+
+    def test_reset_query(self):
+        before = read_flash()
+        self.start_reset()
+
+        # queries do not end the reset
+        ret = self.client.call_raw(proto.Ping(message='query'))
+        assert isinstance(ret, proto.Success)
+        features = self.client.call_raw(proto.GetFeatures())
+        assert features.initialized is False
+        assert read_flash() == before
+
+        ret = self.client.call_raw(proto.EntropyAck(entropy=b'\x00' * 32))
+        ret = self.finish_backup(ret)
+        assert isinstance(ret, proto.Success)
+
+        features = self.client.call_raw(proto.Initialize())
+        assert features.initialized is True
+
+    def test_recovery_query(self):
+        before = read_flash()
+        self.start_recovery()
+
+        ret = self.client.call_raw(proto.Ping(message='query'))
+        assert isinstance(ret, proto.Success)
+        assert read_flash() == before
+
+        # the recovery goes on
+        ret = self.client.call_raw(proto.WordAck(word='abandon'))
+        assert isinstance(ret, proto.WordRequest)
+
+    def test_recovery_interrupted(self):
+        before = read_flash()
+        self.start_recovery()
+
+        ret = self.client.call_raw(proto.ApplySettings(label='other'))
+        assert isinstance(ret, proto.ButtonRequest)
+        self.client.debug.press_yes()
+        ret = self.client.call_raw(proto.ButtonAck())
+        assert isinstance(ret, proto.Success)
+        assert read_flash() != before
+
+        ret = self.client.call_raw(proto.WordAck(word='abandon'))
+        assert isinstance(ret, proto.Failure)
+        assert ret.code == proto.FailureType.UnexpectedMessage
+
+        features = self.client.call_raw(proto.GetFeatures())
+        assert features.initialized is False
+
+    def test_recovery_wrong_word(self):
+        before = read_flash()
+        ret = self.start_recovery()
+        while True:
+            (word, pos) = self.client.debug.read_recovery_word()
+            if pos != 0:
+                break
+            ret = self.client.call_raw(proto.WordAck(word=word))
+            assert isinstance(ret, proto.WordRequest)
+
+        ret = self.client.call_raw(proto.WordAck(word='notaword'))
+        assert isinstance(ret, proto.Failure)
+        assert read_flash() == before
+
+        # the recovery has ended
+        ret = self.client.call_raw(proto.WordAck(word='abandon'))
+        assert isinstance(ret, proto.Failure)
+        assert ret.code == proto.FailureType.UnexpectedMessage
@@ -33,6 +33,14 @@ void uint32hex(uint32_t num, char *str)
 	}
 }
 
+// writes uint32 as 4 little-endian bytes
+void uint32le(uint32_t num, uint8_t *out)
+{
+	for (uint32_t i = 0; i < 4; i++) {
+		out[i] = (num >> (i * 8)) & 0xFF;
+	}
+}
+
 // converts data to hexa
 void data2hex(const void *data, uint32_t len, char *str)
 {
@@ -27,6 +27,22 @@
 #include <libopencm3/cm3/vector.h>
 #endif
 
+#if CTGRIND && !EMULATOR
+#error "CTGRIND is only supported by the emulator"
+#endif
+
+// Constant-time checking under valgrind memcheck: data marked secret is
+// treated as uninitialized, so any branch or memory index depending on it
+// is reported.  Results that may legitimately be revealed are marked public.
+#if CTGRIND
+#include <valgrind/memcheck.h>
+#define CT_SECRET(ptr, len) VALGRIND_MAKE_MEM_UNDEFINED((ptr), (len))
+#define CT_PUBLIC(ptr, len) VALGRIND_MAKE_MEM_DEFINED((ptr), (len))
+#else
+#define CT_SECRET(ptr, len) do { } while (0)
+#define CT_PUBLIC(ptr, len) do { } while (0)
+#endif
+
 // Statement expressions make these macros side-effect safe
 #define MIN(a, b) ({ typeof(a) _a = (a); typeof(b) _b = (b); _a < _b ? _a : _b; })
 #define MAX(a, b) ({ typeof(a) _a = (a); typeof(b) _b = (b); _a > _b ? _a : _b; })
@@ -36,6 +52,9 @@ void delay(uint32_t wait);
 // converts uint32 to hexa (8 digits)
 void uint32hex(uint32_t num, char *str);
 
+// writes uint32 as 4 little-endian bytes
+void uint32le(uint32_t num, uint8_t *out);
+
 // converts data to hexa
 void data2hex(const void *data, uint32_t len, char *str);
 